@@ -0,0 +1,464 @@
+#include "bitboard.h"
+#include "board.h"
+#include "engine.h"
+#include "hash.h"
+#include "movepick.h"
+#include "perft.h"
+#include "types.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace Leaf;
+
+namespace {
+
+  //hardware cache miss counter, reads -1 when perf events are not allowed
+  struct CacheCounter {
+    int fd = -1;
+
+    explicit CacheCounter (uint64_t config, uint32_t type = PERF_TYPE_HW_CACHE) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~CacheCounter () {
+      if (fd >= 0)
+        close(fd);
+    }
+
+    void start () {
+      if (fd < 0) return;
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    long long stop () {
+      if (fd < 0) return -1;
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      long long count = 0;
+      if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+      return count;
+    }
+  };
+
+  std::string counterStr (long long count) {
+    return count < 0 ? "n/a" : std::to_string(count);
+  }
+
+  constexpr uint64_t L1D_READ_MISS = PERF_COUNT_HW_CACHE_L1D
+                                   | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                   | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+  struct BenchPosition {
+    const char* name;
+    const char* fen;
+    int depth;
+  };
+
+  const BenchPosition positions[] = {
+    {"startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4},
+    {"endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5},
+    {"promotions", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4},
+  };
+
+  //quiet positions, the qsearch still explodes on tactical ones
+  const BenchPosition searchPositions[] = {
+    {"startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5},
+    {"italian", "r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3", 4},
+    {"giuoco", "r1bqk2r/pppp1ppp/2n2n2/2b1p3/2B1P3/3P1N2/PPP2PPP/RNBQK2R w KQkq - 1 5", 4},
+    {"endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6},
+  };
+
+  //perft throughput of the slider layout this binary was built with
+  void benchSliders (int extraDepth) {
+#if defined(COMPACT_ATTACKS)
+    const char* layout = "compact";
+#else
+    const char* layout = "magic";
+#endif
+    std::cout << "layout " << layout << " backend " << (UsePext ? "pext" : "magic")
+              << " table_bytes " << Bitboards::slider_table_bytes() << "\n";
+
+    CacheCounter l1(L1D_READ_MISS);
+    CacheCounter llc(PERF_COUNT_HW_CACHE_MISSES, PERF_TYPE_HARDWARE);
+
+    uint64_t totalNodes = 0;
+    double totalSeconds = 0;
+    for (const BenchPosition& p : positions) {
+      Board b;
+      b.loadFEN(p.fen);
+
+      l1.start(); llc.start();
+      auto start = std::chrono::steady_clock::now();
+      uint64_t nodes = perft(b, p.depth + extraDepth);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      long long l1miss = l1.stop(), llcmiss = llc.stop();
+
+      totalNodes += nodes;
+      totalSeconds += seconds;
+      std::cout << p.name << " nodes " << nodes << " nps " << uint64_t(nodes / seconds)
+                << " l1d_miss " << counterStr(l1miss) << " llc_miss " << counterStr(llcmiss) << "\n";
+    }
+    std::cout << "total nodes " << totalNodes << " nps " << uint64_t(totalNodes / totalSeconds) << std::endl;
+  }
+
+  template <typename F>
+    double timed (F f) {
+      auto start = std::chrono::steady_clock::now();
+      f();
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+  //make/unmake against copy-make, perft runs both at runtime while the
+  //search uses whichever one this binary was built with (COPY_MAKE)
+  void benchMake (int extraDepth) {
+    std::cout << "board_bytes " << sizeof(Board) << "\n";
+
+    uint64_t nodes = 0;
+    double makeSeconds = 0, copySeconds = 0;
+    for (const BenchPosition& p : positions) {
+      Board b;
+      b.loadFEN(p.fen);
+      uint64_t made = 0, copied = 0;
+      makeSeconds += timed([&] { made = perft(b, p.depth + extraDepth); });
+      copySeconds += timed([&] { copied = perft_copymake(b, p.depth + extraDepth); });
+      if (made != copied)
+        std::cout << p.name << " MISMATCH " << made << " " << copied << "\n";
+      nodes += made;
+    }
+    std::cout << "perft make_unmake nps " << uint64_t(nodes / makeSeconds)
+              << " copy_make nps " << uint64_t(nodes / copySeconds) << "\n";
+    std::cout << "perft faster " << (makeSeconds <= copySeconds ? "make_unmake" : "copy_make") << "\n";
+
+#if defined(COPY_MAKE)
+    const char* strategy = "copy_make";
+#else
+    const char* strategy = "make_unmake";
+#endif
+    TT tt;
+    Search search(tt);
+    uint64_t searched = 0;
+    double searchSeconds = 0;
+    for (const BenchPosition& p : searchPositions) {
+      Board b;
+      b.loadFEN(p.fen);
+      search.clear();
+      searchSeconds += timed([&] { search.SearchMove(b, p.depth + extraDepth); });
+      searched += search.nodes();
+    }
+    std::cout << "search " << strategy << " nodes " << searched << " nps " << uint64_t(searched / searchSeconds) << std::endl;
+  }
+
+  //search nps with and without prefetching the child's tt entry
+  void benchPrefetch (int extraDepth) {
+    TT tt;
+    Search search(tt);
+    for (bool prefetch : {false, true}) {
+      search.ttPrefetch = prefetch;
+      uint64_t searched = 0;
+      double seconds = 0;
+      for (const BenchPosition& p : searchPositions) {
+        Board b;
+        b.loadFEN(p.fen);
+        search.clear();
+        seconds += timed([&] { search.SearchMove(b, p.depth + extraDepth); });
+        searched += search.nodes();
+      }
+      std::cout << "search prefetch " << (prefetch ? "on" : "off") << " nodes " << searched
+                << " nps " << uint64_t(searched / seconds) << std::endl;
+    }
+  }
+
+  void collectFENs (Board& b, int depth, std::vector<std::string>& fens) {
+    fens.push_back(b.toFEN());
+    if (depth == 0)
+      return;
+    MoveList list;
+    LegalMoves(b, list);
+    Board::State st;
+    for (int i = 0; i < list.count; i++) {
+      b.MakeMove(list.data[i], st);
+      collectFENs(b, depth - 1, fens);
+      b.UnmakeMove(list.data[i]);
+    }
+  }
+
+  //fen parse and write throughput over every position of a small tree
+  void benchFEN (int extraDepth) {
+    std::vector<std::string> fens;
+    for (const BenchPosition& p : positions) {
+      Board b;
+      b.loadFEN(p.fen);
+      collectFENs(b, 2 + extraDepth, fens);
+    }
+
+    Board b;
+    Hash keys = 0;
+    double parseSeconds = timed([&] {
+      for (const std::string& fen : fens) {
+        b.loadFEN(fen);
+        keys ^= b.key;
+      }
+    });
+
+    char buf[MAX_FEN];
+    int mismatches = 0;
+    double writeSeconds = 0;
+    for (const std::string& fen : fens) {
+      b.loadFEN(fen);
+      writeSeconds += timed([&] { b.toFEN(buf); });
+      if (fen != buf || !b.keysOk())
+        mismatches++;
+    }
+
+    //every legal move made and written back: the fen after the move has to
+    //load into the same keys, with the halfmove clock reset by captures
+    //and pawn moves
+    Board made, reloaded;
+    uint64_t roundTrips = 0;
+    int makeMismatches = 0;
+    for (const std::string& fen : fens) {
+      made.loadFEN(fen);
+      MoveList list;
+      LegalMoves(made, list);
+      for (int i = 0; i < list.count; i++) {
+        Move m = list.data[i];
+        bool reset = made.isCapture(m) || type_of(made.data[m.from_sq()]) == PAWN;
+        int halfMove = reset ? 0 : made.halfMove + 1;
+        Board::State st;
+        made.MakeMove(m, st);
+        std::string after = made.toFEN();
+        if (!reloaded.loadFEN(after) || reloaded.key != made.key || reloaded.toFEN() != after
+         || made.halfMove != halfMove)
+          makeMismatches++;
+        made.UnmakeMove(m);
+        roundTrips++;
+      }
+    }
+
+    std::cout << "fen positions " << fens.size() << " mismatches " << mismatches << "\n";
+    std::cout << "fen make round trips " << roundTrips << " mismatches " << makeMismatches << "\n";
+    std::cout << "fen parse pos/s " << uint64_t(fens.size() / parseSeconds)
+              << " write pos/s " << uint64_t(fens.size() / writeSeconds) << std::endl;
+  }
+
+  //both sides' attack maps the per piece way, one lookup per piece
+  void pieceAttackMaps (Board& b, Bitboard maps[COLOR_NB]) {
+    for (Color c : {WHITE, BLACK}) {
+      Bitboard pawns = b.piecebb[make_piece(c, PAWN)];
+      Bitboard attacks = c == WHITE ? pawn_attacks_bb<WHITE>(pawns) : pawn_attacks_bb<BLACK>(pawns);
+      for (int pt = KNIGHT; pt <= KING; pt++) {
+        Bitboard pieces = b.piecebb[make_piece(c, PieceType(pt))];
+        while (pieces)
+          attacks |= attacks_bb(PieceType(pt), pop_lsb(pieces), b.Occupancy[2]);
+      }
+      maps[c] = attacks;
+    }
+  }
+
+  //batch attack maps with the set-wise slider fill (avx2 when the cpu has
+  //it) against per piece magic lookups, over every position of a small
+  //tree, and the two have to agree
+  void benchAttacks (int extraDepth) {
+    std::vector<std::string> fens;
+    for (const BenchPosition& p : positions) {
+      Board b;
+      b.loadFEN(p.fen);
+      collectFENs(b, 2 + extraDepth, fens);
+    }
+    std::vector<Board> boards(fens.size());
+    for (size_t i = 0; i < fens.size(); i++)
+      boards[i].loadFEN(fens[i]);
+
+    int n = int(boards.size());
+    std::unique_ptr<Bitboard[][COLOR_NB]> fill(new Bitboard[n][COLOR_NB]);
+    std::unique_ptr<Bitboard[][COLOR_NB]> lookup(new Bitboard[n][COLOR_NB]);
+    double fillSeconds = timed([&] { attackMaps(boards.data(), n, fill.get()); });
+    double lookupSeconds = timed([&] {
+      for (int i = 0; i < n; i++)
+        pieceAttackMaps(boards[i], lookup[i]);
+    });
+
+    int mismatches = 0;
+    for (int i = 0; i < n; i++)
+      mismatches += fill[i][WHITE] != lookup[i][WHITE] || fill[i][BLACK] != lookup[i][BLACK];
+    std::cout << "attacks positions " << n << " mismatches " << mismatches
+              << " avx2 " << (UseAvx2 ? "on" : "off") << "\n";
+    std::cout << "attacks fill ns/pos " << uint64_t(fillSeconds * 1e9 / n)
+              << " lookup ns/pos " << uint64_t(lookupSeconds * 1e9 / n) << std::endl;
+  }
+
+  //parallel perft on one thread against every hardware thread
+  void benchThreads (int extraDepth) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int n : {1, threads}) {
+      uint64_t nodes = 0;
+      double seconds = 0;
+      for (const BenchPosition& p : positions) {
+        Board b;
+        b.loadFEN(p.fen);
+        PerftResult r = perft_parallel(b, p.depth + 1 + extraDepth, n);
+        nodes += r.nodes;
+        seconds += r.seconds;
+      }
+      std::cout << "perft threads " << n << " nodes " << nodes << " nps " << uint64_t(nodes / seconds) << std::endl;
+      if (threads == 1)
+        break;
+    }
+  }
+
+  //time to depth of the search with one thread against every hardware
+  //thread as lazy smp helpers
+  void benchSMP (int extraDepth) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    TT tt;
+    Search search(tt);
+    for (int n : {1, threads}) {
+      search.threads = n;
+      uint64_t searched = 0;
+      double seconds = 0;
+      for (const BenchPosition& p : searchPositions) {
+        Board b;
+        b.loadFEN(p.fen);
+        search.clear();
+        seconds += timed([&] { search.SearchMove(b, p.depth + 1 + extraDepth); });
+        searched += search.nodes();
+      }
+      std::cout << "search threads " << n << " nodes " << searched << " time_to_depth " << seconds
+                << " nps " << uint64_t(searched / seconds) << std::endl;
+      if (threads == 1)
+        break;
+    }
+  }
+
+  //tree size and time to depth of a plain alpha-beta search, with pvs,
+  //and with pvs inside aspiration windows
+  void benchPVS (int extraDepth) {
+    TT tt;
+    Search search(tt);
+    for (int mode = 0; mode < 3; mode++) {
+      search.pvs = mode >= 1;
+      search.aspiration = mode >= 2;
+      uint64_t searched = 0;
+      double seconds = 0;
+      for (const BenchPosition& p : searchPositions) {
+        Board b;
+        b.loadFEN(p.fen);
+        search.clear();
+        seconds += timed([&] { search.SearchMove(b, p.depth + 1 + extraDepth); });
+        searched += search.nodes();
+      }
+      std::cout << "search pvs " << (search.pvs ? "on" : "off") << " aspiration " << (search.aspiration ? "on" : "off")
+                << " nodes " << searched << " time_to_depth " << seconds << std::endl;
+    }
+  }
+
+  //perft with and without the subtree cache, deeper than the other perft
+  //benches since transpositions only pay off a few plies down
+  void benchPerftHash (int extraDepth) {
+    PerftCache cache(64);
+    for (PerftCache* c : {(PerftCache*) nullptr, &cache}) {
+      uint64_t nodes = 0;
+      double seconds = 0;
+      PerftStats stats;
+      for (const BenchPosition& p : positions) {
+        Board b;
+        b.loadFEN(p.fen);
+        PerftResult r = perft_parallel(b, p.depth + 1 + extraDepth, 1, c);
+        nodes += r.nodes;
+        seconds += r.seconds;
+        stats.probes += r.cache.probes;
+        stats.hits += r.cache.hits;
+      }
+      std::cout << "perft hash " << (c ? "on" : "off") << " nodes " << nodes << " nps " << uint64_t(nodes / seconds)
+                << " hit_rate " << (stats.probes ? double(stats.hits) / stats.probes : 0) << std::endl;
+    }
+  }
+
+  //cost of move ordering: generating every move of a position against
+  //draining a move picker over it, the difference is scoring and picking
+  void benchOrder (int extraDepth) {
+    std::vector<std::string> fens;
+    for (const BenchPosition& p : positions) {
+      Board b;
+      b.loadFEN(p.fen);
+      collectFENs(b, 2 + extraDepth, fens);
+    }
+    std::vector<Board> boards(fens.size());
+    for (size_t i = 0; i < fens.size(); i++)
+      boards[i].loadFEN(fens[i]);
+
+    static History history;
+    history.clear();
+
+    uint64_t generated = 0, picked = 0;
+    double genSeconds = timed([&] {
+      for (Board& b : boards) {
+        MoveList list;
+        LegalMoves(b, list);
+        generated += list.count;
+      }
+    });
+    double pickSeconds = timed([&] {
+      for (Board& b : boards) {
+        MovePicker mp(b, Move::none(), Move::none(), Move::none(), history);
+        while (mp.next())
+          picked++;
+      }
+    });
+
+    double orderNs = (pickSeconds - genSeconds) * 1e9;
+    std::cout << "order positions " << boards.size() << " moves " << generated
+              << (picked == generated ? "" : " MISMATCH") << "\n";
+    std::cout << "order generate ns/pos " << uint64_t(genSeconds * 1e9 / boards.size())
+              << " picker ns/pos " << uint64_t(pickSeconds * 1e9 / boards.size())
+              << " ordering ns/move " << orderNs / generated << std::endl;
+  }
+}
+
+//usage: bench [sliders|make|fen|prefetch|order|threads|perfthash|smp|pvs|attacks] [extra depth]
+int main(int argc, char* argv[]) {
+  Bitboards::init();
+  init_hash();
+
+  std::string mode = argc > 1 ? argv[1] : "all";
+  int extraDepth = argc > 2 ? std::stoi(argv[2]) : 0;
+
+  if (mode == "all" || mode == "sliders")
+    benchSliders(extraDepth);
+  if (mode == "all" || mode == "make")
+    benchMake(extraDepth);
+  if (mode == "all" || mode == "fen")
+    benchFEN(extraDepth);
+  if (mode == "all" || mode == "prefetch")
+    benchPrefetch(extraDepth);
+  if (mode == "all" || mode == "order")
+    benchOrder(extraDepth);
+  if (mode == "threads")
+    benchThreads(extraDepth);
+  if (mode == "perfthash")
+    benchPerftHash(extraDepth);
+  if (mode == "smp")
+    benchSMP(extraDepth);
+  if (mode == "pvs")
+    benchPVS(extraDepth);
+  if (mode == "attacks")
+    benchAttacks(extraDepth);
+}
@@ -1,5 +1,12 @@
 #include "bitboard.h"
+#include "die.h"
+#include "magics.h"
 #include <iostream>
+#include <unordered_map>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace Leaf {
   
@@ -7,15 +14,60 @@ namespace Leaf {
 
   Bitboard PsudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
   Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
+  Bitboard LineBB[SQUARE_NB][SQUARE_NB];
+  Bitboard BetweenBB[SQUARE_NB][SQUARE_NB];
 
   Magic Magics [SQUARE_NB][2];
+#if defined(PEXT_RUNTIME)
+  bool UsePext = false;
+#endif
+  bool UseAvx2 = false;
+
+#if defined(COMPACT_ATTACKS)
+  //4900 distinct rook sets + 1428 bishop sets, slot 0 is kept empty. the
+  //count is checked in every build as the sets are added
+  constexpr int ATTACK_SETS_NB = 4900 + 1428 + 1;
+  Bitboard AttackSets[ATTACK_SETS_NB];
 
   namespace {
+    int attackSetsCount = 1;
+
+    AttackEntry attack_entry (Bitboard attacks) {
+      static std::unordered_map<Bitboard, AttackEntry> ids;
+      auto it = ids.find(attacks);
+      if (it != ids.end())
+        return it->second;
+
+      if (attackSetsCount >= ATTACK_SETS_NB)
+        die("more distinct slider attack sets than ATTACK_SETS_NB");
+      AttackSets[attackSetsCount] = attacks;
+      ids.emplace(attacks, AttackEntry(attackSetsCount));
+      return AttackEntry(attackSetsCount++);
+    }
+  }
+#else
+  namespace {
+    AttackEntry attack_entry (Bitboard attacks) {
+      return attacks;
+    }
+  }
+#endif
+
+  namespace {
+
+    AttackEntry RookTable [0x19000];
+    AttackEntry BishopTable [0x1480];
 
-    Bitboard RookTable [0x19000];
-    Bitboard BishopTable [0x1480];
+    void init_magics (PieceType pt, AttackEntry table[], const Bitboard magics[], Magic Magics [][2]);
+    Bitboard sliding_shots (PieceType pt, Square sq, Bitboard occupancy);
+    Bitboard magic_mask (PieceType pt, Square sq);
 
-    void init_magics (PieceType pt, Bitboard table[], Magic Magics [][2]);
+    void init_square_distance () {
+      for (Square s1 = a1; s1 <= h8; ++s1)
+        for (Square s2 = a1; s2 <= h8; ++s2) {
+          SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
+        }
+    }
 
     Bitboard safe_distance (Square s, int steps) {
       Square to = Square(s + steps);
@@ -24,17 +76,25 @@ namespace Leaf {
   }
 
 
-  void Bitboards::init () {
+  void Bitboards::init (StartupProfile* profile) {
 
 
     //SQdiS init
-    for (Square s1 = a1; s1 <= h8; ++s1)
-      for (Square s2 = a1; s2 <= h8; ++s2) {
-        SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
-      }
-
-    init_magics (BISHOP, BishopTable, Magics);
-    init_magics (ROOK, RookTable, Magics);
+    init_square_distance();
+    if (profile) profile->mark("square distance");
+
+#if defined(PEXT_RUNTIME)
+    UsePext = __builtin_cpu_supports("bmi2");
+#endif
+#if defined(__x86_64__)
+    UseAvx2 = __builtin_cpu_supports("avx2");
+#endif
+    const std::string backend = UsePext ? " (pext)" : " (magic)";
+
+    init_magics (BISHOP, BishopTable, BishopMagics, Magics);
+    if (profile) profile->mark("bishop attacks" + backend);
+    init_magics (ROOK, RookTable, RookMagics, Magics);
+    if (profile) profile->mark("rook attacks" + backend);
 
     for (Square s1 = a1; s1 <= h8; ++s1) {
 
@@ -48,6 +108,155 @@ namespace Leaf {
         PsudoAttacks[KNIGHT][s1] |= safe_distance(s1, step);
 
     }
+    if (profile) profile->mark("leaper attacks");
+
+    for (Square s1 = a1; s1 <= h8; ++s1) {
+      PsudoAttacks[BISHOP][s1] = attacks_bb<BISHOP>(s1, 0);
+      PsudoAttacks[ROOK][s1] = attacks_bb<ROOK>(s1, 0);
+      PsudoAttacks[QUEEN][s1] = PsudoAttacks[BISHOP][s1] | PsudoAttacks[ROOK][s1];
+
+      for (PieceType pt : {BISHOP, ROOK})
+        for (Square s2 = a1; s2 <= h8; ++s2) {
+          if (!(PsudoAttacks[pt][s1] & s2))
+            continue;
+          LineBB[s1][s2] = (attacks_bb(pt, s1, 0) & attacks_bb(pt, s2, 0)) | s1 | s2;
+          BetweenBB[s1][s2] = attacks_bb(pt, s1, square_bb(s2)) & attacks_bb(pt, s2, square_bb(s1));
+        }
+    }
+    if (profile) profile->mark("line tables");
+  }
+
+  namespace {
+
+    //occluded fill towards higher squares (N, E, NE, NW), the mask drops
+    //squares that wrapped around the board edge
+    template <int step>
+      Bitboard fill_up (Bitboard gen, Bitboard empty, Bitboard mask) {
+        empty &= mask;
+        gen |= empty & (gen << step);
+        empty &= empty << step;
+        gen |= empty & (gen << 2 * step);
+        empty &= empty << 2 * step;
+        gen |= empty & (gen << 4 * step);
+        return (gen << step) & mask;
+      }
+    template <int step>
+      Bitboard fill_down (Bitboard gen, Bitboard empty, Bitboard mask) {
+        empty &= mask;
+        gen |= empty & (gen >> step);
+        empty &= empty >> step;
+        gen |= empty & (gen >> 2 * step);
+        empty &= empty >> 2 * step;
+        gen |= empty & (gen >> 4 * step);
+        return (gen >> step) & mask;
+      }
+
+    Bitboard sliding_attacks_scalar (Bitboard rooks, Bitboard bishops, Bitboard occupied) {
+      Bitboard empty = ~occupied;
+      return fill_up<8>(rooks, empty, ~0ULL)
+           | fill_up<1>(rooks, empty, ~FileABB)
+           | fill_up<9>(bishops, empty, ~FileABB)
+           | fill_up<7>(bishops, empty, ~FileHBB)
+           | fill_down<8>(rooks, empty, ~0ULL)
+           | fill_down<1>(rooks, empty, ~FileHBB)
+           | fill_down<9>(bishops, empty, ~FileHBB)
+           | fill_down<7>(bishops, empty, ~FileABB);
+    }
+
+#if defined(__x86_64__)
+    //same fills with one direction per 64 bit lane: {N, E, NE, NW} upwards
+    //and {S, W, SW, SE} downwards
+    __attribute__((target("avx2")))
+    Bitboard sliding_attacks_avx2 (Bitboard rooks, Bitboard bishops, Bitboard occupied) {
+      const __m256i steps = _mm256_setr_epi64x(8, 1, 9, 7);
+      const __m256i steps2 = _mm256_slli_epi64(steps, 1);
+      const __m256i steps4 = _mm256_slli_epi64(steps, 2);
+      const __m256i upMask = _mm256_setr_epi64x(~0LL, ~FileABB, ~FileABB, ~FileHBB);
+      const __m256i downMask = _mm256_setr_epi64x(~0LL, ~FileHBB, ~FileHBB, ~FileABB);
+      const __m256i gen0 = _mm256_setr_epi64x(rooks, rooks, bishops, bishops);
+      const __m256i empty0 = _mm256_set1_epi64x(~occupied);
+
+      __m256i gen = gen0;
+      __m256i empty = _mm256_and_si256(empty0, upMask);
+      gen = _mm256_or_si256(gen, _mm256_and_si256(empty, _mm256_sllv_epi64(gen, steps)));
+      empty = _mm256_and_si256(empty, _mm256_sllv_epi64(empty, steps));
+      gen = _mm256_or_si256(gen, _mm256_and_si256(empty, _mm256_sllv_epi64(gen, steps2)));
+      empty = _mm256_and_si256(empty, _mm256_sllv_epi64(empty, steps2));
+      gen = _mm256_or_si256(gen, _mm256_and_si256(empty, _mm256_sllv_epi64(gen, steps4)));
+      __m256i attacks = _mm256_and_si256(_mm256_sllv_epi64(gen, steps), upMask);
+
+      gen = gen0;
+      empty = _mm256_and_si256(empty0, downMask);
+      gen = _mm256_or_si256(gen, _mm256_and_si256(empty, _mm256_srlv_epi64(gen, steps)));
+      empty = _mm256_and_si256(empty, _mm256_srlv_epi64(empty, steps));
+      gen = _mm256_or_si256(gen, _mm256_and_si256(empty, _mm256_srlv_epi64(gen, steps2)));
+      empty = _mm256_and_si256(empty, _mm256_srlv_epi64(empty, steps2));
+      gen = _mm256_or_si256(gen, _mm256_and_si256(empty, _mm256_srlv_epi64(gen, steps4)));
+      attacks = _mm256_or_si256(attacks, _mm256_and_si256(_mm256_srlv_epi64(gen, steps), downMask));
+
+      __m128i half = _mm_or_si128(_mm256_castsi256_si128(attacks), _mm256_extracti128_si256(attacks, 1));
+      return Bitboard(_mm_cvtsi128_si64(half) | _mm_extract_epi64(half, 1));
+    }
+#endif
+  }
+
+  Bitboard sliding_attacks (Bitboard rooks, Bitboard bishops, Bitboard occupied) {
+#if defined(__x86_64__)
+    if (UseAvx2)
+      return sliding_attacks_avx2(rooks, bishops, occupied);
+#endif
+    return sliding_attacks_scalar(rooks, bishops, occupied);
+  }
+
+  size_t Bitboards::slider_table_bytes () {
+#if defined(COMPACT_ATTACKS)
+    return sizeof(RookTable) + sizeof(BishopTable) + attackSetsCount * sizeof(Bitboard);
+#else
+    return sizeof(RookTable) + sizeof(BishopTable);
+#endif
+  }
+
+  //brute force search of a magic for one square, only used by magicgen
+  //to regenerate magics.h. the engine itself never calls this.
+  Bitboard Bitboards::find_magic (PieceType pt, Square sq, std::mt19937_64& gen) {
+    static Bitboard table[4096];
+    Bitboard occupancy[4096];
+    Bitboard refrence[4096];
+    int epoch[4096] = {};
+    int cnt = 0;
+    int size = 0;
+
+    init_square_distance();
+    Bitboard mask = magic_mask(pt, sq);
+    unsigned int shift = 64 - popcount(mask);
+
+    Bitboard b = 0;
+    do {
+      occupancy[size] = b;
+      refrence[size] = sliding_shots (pt, sq, b);
+      size++;
+      b = (b - mask) & mask;
+    } while (b);
+
+    std::uniform_int_distribution<uint64_t> dist(0, UINT64_MAX);
+    while (true) {
+      Bitboard candidate = dist(gen) & dist(gen) & dist(gen);
+      cnt++;
+      bool fail = false;
+
+      for (int i = 0; i < size; i++) {
+        unsigned int index = (occupancy[i] * candidate) >> shift;
+        if (epoch[index] < cnt) {
+          epoch[index] = cnt;
+          table[index] = refrence[i];
+        }
+        else if (table[index] != refrence[i]) {
+          fail = true;
+          break;
+        }
+      }
+      if (!fail) return candidate;
+    }
   }
 
    namespace {
@@ -69,60 +278,38 @@ namespace Leaf {
       return attacks;
     }
 
-    inline Bitboard rand64(std::mt19937_64& gen) {
-      std::uniform_int_distribution<uint64_t> dist(0, UINT64_MAX);
-      return dist(gen);
+    Bitboard magic_mask (PieceType pt, Square sq) {
+      Bitboard edges = ( ((Rank1BB | Rank8BB) & ~rank_bb(sq)) | ((FileABB | FileHBB) & ~file_bb(sq)) );
+      return sliding_shots(pt, sq, 0) & ~edges;
     }
 
-    void init_magics (PieceType pt, Bitboard table[], Magic Magics[][2]) {
+    //fills the attack tables in one pass from the shipped magics in magics.h,
+    //with pext the same slots are used but indexed by the extracted bits
+    void init_magics (PieceType pt, AttackEntry table[], const Bitboard magics[], Magic Magics[][2]) {
 
-      Bitboard occupancy[4096];
-      Bitboard refrence[4096];
-      int epoch[4096] = {};
-      int cnt = 0;
       int size = 0;
 
       for (Square sx = a1; sx <= h8; ++sx) {
 
-        Bitboard edges = ( ((Rank1BB | Rank8BB) & ~rank_bb(sx)) | ((FileABB | FileHBB) & ~file_bb(sx)) );
-
         Magic& m = Magics[sx][pt - BISHOP];
-        m.mask = sliding_shots(pt, sx, 0) & ~edges;
+        m.mask = magic_mask(pt, sx);
         m.shift = 64 - popcount(m.mask);
+        m.magic = magics[sx];
         m.attacks = sx == a1 ? table : Magics[sx - 1][pt - BISHOP].attacks + size;
 
         size = 0;
         Bitboard b = 0;
 
         do {
-          occupancy[size] = b;
-          refrence[size] = sliding_shots (pt, sx, b);
+          AttackEntry& entry = m.attacks[m.index(b)];
+          AttackEntry shots = attack_entry(sliding_shots (pt, sx, b));
+          //a stale magics.h would collide here, regenerate it with magicgen
+          if (entry && entry != shots)
+            die("slider magic collision, magics.h is stale");
+          entry = shots;
           size++;
           b = (b - m.mask) & m.mask;
         } while (b);
-
-        std::mt19937_64 gen (std::random_device{}());
-        Bitboard candidate;
-        while (true) {
-          candidate = rand64(gen) & rand64(gen) & rand64(gen);
-          cnt++;
-          bool fail = false;
-
-          for (int i = 0; i < size; i++) {
-            int index = (occupancy[i] * candidate) >> m.shift;
-            if (epoch[index] < cnt) {
-              epoch[index] = cnt;
-              m.attacks[index] = refrence[i];
-            }
-            else if (m.attacks[index] != refrence[i]) {
-              fail = true;
-              break;
-            }
-          }
-          if (!fail) break;
-        }
-        m.magic = candidate;
-
       }
     }
   }
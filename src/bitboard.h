@@ -6,12 +6,18 @@
 #include <cmath>
 #include <random>
 
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 #include "types.h"
+#include "profile.h"
 
 namespace Leaf {
   namespace Bitboards {
-    void init();
+    void init(StartupProfile* profile = nullptr);
     std::string pretty ();
+    Bitboard find_magic (PieceType pt, Square sq, std::mt19937_64& gen);
   }
 
   constexpr Bitboard FileABB = 0x0101010101010101ULL;
@@ -55,23 +61,70 @@ namespace Leaf {
 
   extern Bitboard PsudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
   extern Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
+  //full line through two aligned squares, and the squares strictly between
+  extern Bitboard LineBB[SQUARE_NB][SQUARE_NB];
+  extern Bitboard BetweenBB[SQUARE_NB][SQUARE_NB];
+
+  //pext indexes the slider tables instead of the magic multiply. the
+  //choice is fixed at compile time when NO_PEXT is set or the target has
+  //BMI2, so the hot path has no branch; other x86-64 builds ask the cpu
+  //once in Bitboards::init
+#if defined(NO_PEXT) || !defined(__x86_64__)
+  constexpr bool UsePext = false;
+#elif defined(__BMI2__)
+  constexpr bool UsePext = true;
+#else
+#define PEXT_RUNTIME
+  extern bool UsePext;
+#endif
+
+  inline Bitboard pext (Bitboard b, Bitboard mask) {
+#if defined(__BMI2__)
+    return _pext_u64(b, mask);
+#elif defined(__x86_64__) && !defined(NO_PEXT)
+    Bitboard r;
+    asm ("pextq %2, %1, %0" : "=r" (r) : "r" (b), "r" (mask));
+    return r;
+#else
+    assert(false);
+    return 0;
+#endif
+  }
+
+  //with COMPACT_ATTACKS the per square tables hold 16 bit ids into one
+  //shared set of distinct attack bitboards (~260KB instead of ~840KB)
+#if defined(COMPACT_ATTACKS)
+  using AttackEntry = uint16_t;
+  extern Bitboard AttackSets[];
+#else
+  using AttackEntry = Bitboard;
+#endif
 
   struct Magic {
     Bitboard mask;
-    Bitboard* attacks;
+    AttackEntry* attacks;
     Bitboard magic;
     unsigned int shift;
     
     unsigned int index (Bitboard occupied) {
+      if (UsePext)
+        return static_cast<unsigned int> (pext(occupied, mask));
       return static_cast<unsigned int> (((occupied & mask) * magic) >> shift);
     }
 
     Bitboard attacks_bb (Bitboard occupied) {
+#if defined(COMPACT_ATTACKS)
+      return AttackSets[attacks[index(occupied)]];
+#else
       return attacks[index(occupied)];
+#endif
     }
   };
 
   extern Magic Magics [SQUARE_NB][2];
+  namespace Bitboards {
+    size_t slider_table_bytes ();
+  }
   constexpr Bitboard square_bb (Square s) {
     return (1ULL << s);
   }
@@ -173,6 +226,19 @@ namespace Leaf {
     }
   }
 
+  //set-wise attacks of all orthogonal (rooks) and diagonal (bishops) sliders
+  //at once with Kogge-Stone occluded fills, queens go in both sets.
+  //runs four ray directions per AVX2 vector when the cpu has it
+  extern bool UseAvx2;
+  Bitboard sliding_attacks (Bitboard rooks, Bitboard bishops, Bitboard occupied);
+
+  inline bool more_than_one (Bitboard b) {
+    return b & (b - 1);
+  }
+  inline bool aligned (Square s1, Square s2, Square s3) {
+    return LineBB[s1][s2] & s3;
+  }
+
   inline Square lsb (Bitboard b) {
     return Square(__builtin_ctzll(b));
   }
@@ -1,29 +1,55 @@
 #include "board.h"
 #include "hash.h"
+#include "movegen.h"
 #include "types.h"
 #include <cstdint>
 #include <string>
-#include <sstream>
-#include <cctype>
+#include <string_view>
+#include <charconv>
 #include <iostream>
+#include <algorithm>
 
 namespace Leaf {
 
 
+  Board Board::child () {
+    if (!history.data)
+      ownHistory();
+    return *this;
+  }
+
+  Board Board::fork () const {
+    Board b(*this);
+    if (b.history.data)
+      b.ownHistory();
+    return b;
+  }
+
+  void Board::ownHistory () {
+    std::unique_ptr<State[]> states(new State[MAX_GAME_PLY + MAX_PLY]);
+    if (history.data)
+      std::copy(history.data, history.data + history.count, states.get());
+    storage.states = std::move(states);
+    history.data = storage.states.get();
+  }
+
   void Board::clearBoard () {
     for (int i = 0; i < PIECE_NB; i++) {
       piecebb[i] = 0;
     }
     key = 0;
+    pawnKey = 0;
+    materialKey = 0;
     CastleRights = 0;
     turn = WHITE;
     Enpassant = Sq0;
     halfMove = 0;
+    fullMove = 1;
     history.clear();
 
     for (Piece& p : data) p = NO_PIECE;
 
-    updateOccupancy ();
+    Occupancy[WHITE] = Occupancy[BLACK] = Occupancy[2] = 0;
     
   }
   void Board::updateOccupancy () {
@@ -54,69 +80,204 @@ namespace Leaf {
     }
   }
 
-  bool Board::loadFEN (const std::string& fen) {
+  namespace {
+    constexpr std::string_view PieceChars = " PNBRQK  pnbrqk";
 
-    std::istringstream iss (fen);
-    std::string placement, side, castling, ep, halfMove;
+    //next space separated field of a fen, empty at the end
+    std::string_view nextField (std::string_view& fen) {
+      size_t start = fen.find_first_not_of(' ');
+      if (start == std::string_view::npos) {
+        fen = {};
+        return {};
+      }
+      fen.remove_prefix(start);
+      size_t end = std::min(fen.find(' '), fen.size());
+      std::string_view field = fen.substr(0, end);
+      fen.remove_prefix(end);
+      return field;
+    }
 
-    if (!(iss >> placement >> side >> castling >> ep >> halfMove)) return false;
+    //eight ranks of eight files, known piece letters and exactly one king
+    //a side, everything after loading relies on the kings being there
+    bool validPlacement (std::string_view placement) {
+      int rank = RANK_8, file = FILE_A;
+      int kings[COLOR_NB] = {};
+
+      for (char c : placement) {
+        if (c == '/') {
+          if (file != FILE_NB || --rank < RANK_1) return false;
+          file = FILE_A;
+        } else if (c >= '1' && c <= '8') {
+          file += c - '0';
+          if (file > FILE_NB) return false;
+        } else {
+          size_t idx = PieceChars.find(c);
+          if (idx == std::string_view::npos || c == ' ' || file >= FILE_NB)
+            return false;
+          if (type_of(Piece(idx)) == KING)
+            kings[color_of(Piece(idx))]++;
+          file++;
+        }
+      }
+      return rank == RANK_1 && file == FILE_NB && kings[WHITE] == 1 && kings[BLACK] == 1;
+    }
 
-    clearBoard();
+    //writes n as decimal and returns the end
+    char* writeInt (char* out, int n) {
+      char digits[12];
+      int len = 0;
+      do {
+        digits[len++] = char('0' + n % 10);
+        n /= 10;
+      } while (n);
+      while (len)
+        *out++ = digits[--len];
+      return out;
+    }
+  }
 
-    Square sq = a8;
+  //single pass: setPiece fills bitboards, mailbox and all keys as the
+  //placement is read, so nothing is rescanned or rehashed afterwards.
+  //the fields are checked and the pieces placed on a scratch board before
+  //this one is touched, a rejected fen leaves the board as it was. the move counters are optional, as in most
+  //epd files
+  bool Board::loadFEN (std::string_view fen) {
+
+    std::string_view placement = nextField(fen);
+    std::string_view side = nextField(fen);
+    std::string_view castling = nextField(fen);
+    std::string_view ep = nextField(fen);
+    std::string_view half = nextField(fen);
+    std::string_view full = nextField(fen);
+
+    if (!validPlacement(placement) || (side != "w" && side != "b") || castling.empty()
+     || castling.find_first_not_of("KQkq-") != std::string_view::npos)
+      return false;
+    if (ep != "-" && (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' || (ep[1] != '3' && ep[1] != '6')))
+      return false;
+
+    Board placed;
+    placed.clearBoard();
+
+    int rank = RANK_8, file = FILE_A;
 
     for (char c : placement) {
       if (c == '/') {
-        sq -= Direction(16);
-      } else if (std::isdigit(c)) {
-        sq += Direction(c - '0');
+        --rank;
+        file = FILE_A;
+      } else if (c >= '1' && c <= '8') {
+        file += c - '0';
       } else {
-        Piece p = NO_PIECE;
-
-        switch (c) {
-          case 'P' : p = W_PAWN; break;
-          case 'R' : p = W_ROOK; break;
-          case 'N' : p = W_KNIGHT; break;
-          case 'B' : p = W_BISHOP; break;
-          case 'Q' : p = W_QUEEN; break;
-          case 'K' : p = W_KING; break;
-          case 'p' : p = B_PAWN; break;
-          case 'r' : p = B_ROOK; break;
-          case 'n' : p = B_KNIGHT; break;
-          case 'b' : p = B_BISHOP; break;
-          case 'q' : p = B_QUEEN; break;
-          case 'k' : p = B_KING; break;
-          default : return false;
-        }
-
-        setPiece (p, sq);
-        sq += Direction(1);
-
+        placed.setPiece (Piece(PieceChars.find(c)), make_square(File(file), Rank(rank)));
+        file++;
       }
     }
 
-    turn = (side == "w") ? WHITE : BLACK;
+    //the side to move could take the king, the search would go on without it
+    Color us = side == "w" ? WHITE : BLACK;
+    if (placed.attackersTo(placed.getKingSq(~us)) & placed.Occupancy[us])
+      return false;
 
-    if (castling.find('K') != std::string::npos) CastleRights |= WHITE_OO;
-    if (castling.find('Q') != std::string::npos)  CastleRights |= WHITE_OOO;
-    if (castling.find('k') != std::string::npos) CastleRights |= BLACK_OO;
-    if (castling.find('q') != std::string::npos) CastleRights |= BLACK_OOO;
+    clearBoard();
+    std::copy(std::begin(placed.piecebb), std::end(placed.piecebb), piecebb);
+    std::copy(std::begin(placed.data), std::end(placed.data), data);
+    std::copy(std::begin(placed.Occupancy), std::end(placed.Occupancy), Occupancy);
+    key = placed.key;
+    pawnKey = placed.pawnKey;
+    materialKey = placed.materialKey;
+
+    turn = (side[0] == 'w') ? WHITE : BLACK;
+    if (turn == BLACK)
+      key ^= colorhash();
+
+    for (char c : castling) {
+      switch (c) {
+        case 'K' : CastleRights |= WHITE_OO; break;
+        case 'Q' : CastleRights |= WHITE_OOO; break;
+        case 'k' : CastleRights |= BLACK_OO; break;
+        case 'q' : CastleRights |= BLACK_OOO; break;
+        default : break;
+      }
+    }
+    key ^= castlehash(CastleRights);
 
     if (ep == "-") {
       Enpassant = Sq0;
     } else {
-      int file = ep[0] - 'a';
-      int rank = ep[1] - '1';
-      Enpassant = Square(int(rank * 8 + file));
+      Enpassant = make_square(File(ep[0] - 'a'), Rank(ep[1] - '1'));
+      key ^= ephash(Enpassant);
     }
 
-    halfMove = std::stoi(halfMove);
+    halfMove = 0;
+    fullMove = 1;
+    if (!half.empty())
+      std::from_chars(half.data(), half.data() + half.size(), halfMove);
+    if (!full.empty())
+      std::from_chars(full.data(), full.data() + full.size(), fullMove);
 
-    updateOccupancy ();
-    key = compute_hash();
+    setCheckInfo();
     return true;
   }
 
+  //writes the fen into out (at least MAX_FEN bytes), nul terminated,
+  //returns its length
+  int Board::toFEN (char* out) const {
+    char* p = out;
+
+    for (int r = RANK_8; r >= RANK_1; r--) {
+      int empty = 0;
+      for (int f = FILE_A; f <= FILE_H; f++) {
+        Piece pc = data[make_square(File(f), Rank(r))];
+        if (pc == NO_PIECE) {
+          empty++;
+          continue;
+        }
+        if (empty)
+          *p++ = char('0' + empty);
+        empty = 0;
+        *p++ = PieceChars[pc];
+      }
+      if (empty)
+        *p++ = char('0' + empty);
+      if (r != RANK_1)
+        *p++ = '/';
+    }
+
+    *p++ = ' ';
+    *p++ = turn == WHITE ? 'w' : 'b';
+    *p++ = ' ';
+
+    if (!CastleRights)
+      *p++ = '-';
+    if (CastleRights & WHITE_OO) *p++ = 'K';
+    if (CastleRights & WHITE_OOO) *p++ = 'Q';
+    if (CastleRights & BLACK_OO) *p++ = 'k';
+    if (CastleRights & BLACK_OOO) *p++ = 'q';
+    *p++ = ' ';
+
+    if (Enpassant == Sq0)
+      *p++ = '-';
+    else {
+      *p++ = char('a' + file_of(Enpassant));
+      *p++ = char('1' + rank_of(Enpassant));
+    }
+    *p++ = ' ';
+
+    p = writeInt(p, halfMove);
+    *p++ = ' ';
+    p = writeInt(p, fullMove);
+    *p = '\0';
+
+    assert(p - out < MAX_FEN);
+    return int(p - out);
+  }
+
+  std::string Board::toFEN () const {
+    char buf[MAX_FEN];
+    int len = toFEN(buf);
+    return std::string(buf, len);
+  }
+
   void Board::print() {
     for (int r = 7; r >= 0; r--)
       for (int f = 0; f < 8; f++) {
@@ -150,59 +311,32 @@ namespace Leaf {
     std::cout << "X A B C D E F G H\n" << std::endl;
   }
 
-  bool Board::squareAttacked (Color by, Bitboard sqs) {
-    Bitboard king, queen, rook, bishop, knight, pawn;
-    if (by == WHITE) {
-      king = piecebb[W_KING];
-      queen = piecebb[W_QUEEN];
-      rook = piecebb[W_ROOK];
-      bishop = piecebb[W_BISHOP];
-      knight = piecebb[W_KNIGHT];
-      pawn = piecebb[W_PAWN];
-    } else {
-      king = piecebb[B_KING];
-      queen = piecebb[B_QUEEN];
-      rook = piecebb[B_ROOK];
-      bishop = piecebb[B_BISHOP];
-      knight = piecebb[B_KNIGHT];
-      pawn = piecebb[B_PAWN];
-    }
-    //fuuuuuuuuuuu
-    Bitboard attacks = 0ULL;
+  //every square attacked by one side, sliders are filled set-wise
+  Bitboard Board::attacksBy (Color by) {
+    Bitboard queens = piecebb[make_piece(by, QUEEN)];
+    Bitboard knights = piecebb[make_piece(by, KNIGHT)];
+    Bitboard pawns = piecebb[make_piece(by, PAWN)];
+    Bitboard attacks = sliding_attacks(piecebb[make_piece(by, ROOK)] | queens,
+                                       piecebb[make_piece(by, BISHOP)] | queens,
+                                       Occupancy[2]);
 
-    while (knight) {
-      Square sq = pop_lsb(knight);
-      attacks |= PsudoAttacks[KNIGHT][sq];
-    }
+    while (knights)
+      attacks |= PsudoAttacks[KNIGHT][pop_lsb(knights)];
 
-    while (rook) {
-      Square sq = pop_lsb(rook);
-      attacks |= attacks_bb<ROOK>(sq, Occupancy[2]);
-    }
+    attacks |= PsudoAttacks[KING][getKingSq(by)];
+    attacks |= by == WHITE ? pawn_attacks_bb<WHITE>(pawns) : pawn_attacks_bb<BLACK>(pawns);
 
-    while (bishop) {
-      Square sq = pop_lsb(bishop);
-      attacks |= attacks_bb<BISHOP>(sq, Occupancy[2]);
-    }
+    return attacks;
+  }
 
-    while (queen) {
-      Square sq = pop_lsb(queen);
-      attacks |= attacks_bb<BISHOP>(sq, Occupancy[2]) | attacks_bb<ROOK>(sq, Occupancy[2]);
+  void attackMaps (Board boards[], int n, Bitboard maps[][COLOR_NB]) {
+    for (int i = 0; i < n; i++) {
+      maps[i][WHITE] = boards[i].attacksBy(WHITE);
+      maps[i][BLACK] = boards[i].attacksBy(BLACK);
     }
-
-    Square ks = pop_lsb(king);
-    attacks |= PsudoAttacks[KING][ks];
-
-    if (by == WHITE)
-      attacks |= pawn_attacks_bb<WHITE>(pawn);
-    else
-      attacks |= pawn_attacks_bb<BLACK>(pawn);
-
-    return attacks & sqs;
   }
 
 
-
   void Board::moveRooks (Square to, int recover) {
     Square rook_from;
     Square rook_to;
@@ -262,8 +396,12 @@ namespace Leaf {
     state.Captured = captured;
     state.Enpassant = Enpassant;
     state.halfMove = halfMove;
+    state.ci = ci;
 
 
+    //counts plies since the last capture or pawn move, reset below
+    halfMove++;
+
     if (pxx != NO_PIECE) {
       captured = pxx;
       state.Captured = captured;
@@ -317,19 +455,24 @@ namespace Leaf {
     if (Enpassant != Sq0)
       key ^= ephash(Enpassant);
 
-    if (oldrights != CastleRights) {
-
-    }
+    if (oldrights != CastleRights)
+      key ^= castlehash(oldrights) ^ castlehash(CastleRights);
 
+    if (!history.data)
+      ownHistory();
     history.push_back(state);
-    halfMove++;
+    fullMove += turn == BLACK;
     key ^= colorhash();
     turn = ~turn;
+    setCheckInfo();
+#if defined(VERIFY_KEYS)
+    assert(keysOk());
+#endif
 
   }
 
   void Board::UnmakeMove (const Move& move) {
-    State state = history.back();
+    const State& state = history.back();
     history.pop_back();
 
     Square from = move.from_sq();
@@ -337,6 +480,7 @@ namespace Leaf {
     MoveType type = move.type_of();
 
     turn = ~turn;
+    fullMove -= turn == BLACK;
 
     Piece moved = getPiece(to);
 
@@ -366,6 +510,10 @@ namespace Leaf {
     Enpassant = state.Enpassant;
     halfMove = state.halfMove;
     key = state.key;
+    ci = state.ci;
+#if defined(VERIFY_KEYS)
+    assert(keysOk());
+#endif
 
   }
 
@@ -381,17 +529,231 @@ namespace Leaf {
     halfMove++;
     key ^= colorhash();
     turn = ~turn;
+    state.ci = ci;
+    setCheckInfo();
+#if defined(VERIFY_KEYS)
+    assert(keysOk());
+#endif
   }
   void Board::UnmakeNULLMove (State& state) {
     key = state.key;
     halfMove = state.halfMove;
     Enpassant = state.Enpassant;
+    ci = state.ci;
     turn = ~turn;
+#if defined(VERIFY_KEYS)
+    assert(keysOk());
+#endif
+  }
+
+
+
+
+  //pieces of either colour that are the only thing between s and one of
+  //the given sliders, pinners gets the sliders pinning a piece of s's side
+  Bitboard Board::sliderBlockers (Bitboard sliders, Square s, Bitboard& pinners) {
+    Bitboard blockers = 0;
+    pinners = 0;
+
+    Bitboard queens = piecebb[W_QUEEN] | piecebb[B_QUEEN];
+    Bitboard snipers = ((PsudoAttacks[ROOK][s] & (piecebb[W_ROOK] | piecebb[B_ROOK] | queens))
+                      | (PsudoAttacks[BISHOP][s] & (piecebb[W_BISHOP] | piecebb[B_BISHOP] | queens))) & sliders;
+    Bitboard occupancy = Occupancy[2] ^ snipers;
+    Bitboard own = Occupancy[color_of(data[s])];
+
+    while (snipers) {
+      Square sniper = pop_lsb(snipers);
+      Bitboard b = BetweenBB[s][sniper] & occupancy;
+
+      if (b && !more_than_one(b)) {
+        blockers |= b;
+        if (b & own)
+          pinners |= sniper;
+      }
+    }
+    return blockers;
+  }
+
+  void Board::setCheckInfo () {
+    Color us = turn, them = ~turn;
+    Square ksq = getKingSq(them);
+
+    ci.checkers = attackersTo(getKingSq(us)) & Occupancy[them];
+    ci.blockersForKing[WHITE] = sliderBlockers(Occupancy[BLACK], getKingSq(WHITE), ci.pinners[BLACK]);
+    ci.blockersForKing[BLACK] = sliderBlockers(Occupancy[WHITE], getKingSq(BLACK), ci.pinners[WHITE]);
+
+    ci.checkSquares[NO_PIECE_TYPE] = 0;
+    ci.checkSquares[PAWN] = pawn_attacks_bb(them, ksq);
+    ci.checkSquares[KNIGHT] = PsudoAttacks[KNIGHT][ksq];
+    ci.checkSquares[BISHOP] = attacks_bb<BISHOP>(ksq, Occupancy[2]);
+    ci.checkSquares[ROOK] = attacks_bb<ROOK>(ksq, Occupancy[2]);
+    ci.checkSquares[QUEEN] = ci.checkSquares[BISHOP] | ci.checkSquares[ROOK];
+    ci.checkSquares[KING] = 0;
+  }
+
+  //answered from the cached check info, the board is not touched
+  bool Board::givesCheck (Move m) {
+    Square from = m.from_sq();
+    Square to = m.to_sq();
+    Color us = turn;
+    Square ksq = getKingSq(~us);
+
+    //direct check
+    if (ci.checkSquares[type_of(data[from])] & to)
+      return true;
+
+    //discovered check
+    if ((ci.blockersForKing[~us] & from) && !aligned(from, to, ksq))
+      return true;
+
+    switch (m.type_of()) {
+      case NORMAL :
+        return false;
+
+      case PROMOTION :
+        return attacks_bb(m.promotion_type(), to, Occupancy[2] ^ from) & ksq;
+
+      case EN_PASSANT : {
+        Square capsq = to - pawn_push(us);
+        Bitboard b = (Occupancy[2] ^ from ^ capsq) | to;
+        Bitboard queens = piecebb[make_piece(us, QUEEN)];
+        return (attacks_bb<ROOK>(ksq, b) & (piecebb[make_piece(us, ROOK)] | queens))
+             | (attacks_bb<BISHOP>(ksq, b) & (piecebb[make_piece(us, BISHOP)] | queens));
+      }
+
+      default : {
+        //castling, the rook lands next to the king
+        Square rfrom = to > from ? to + EAST : to + WEST + WEST;
+        Square rto = to > from ? to + WEST : to + EAST;
+        return attacks_bb<ROOK>(rto, (Occupancy[2] ^ from ^ rfrom) | to | rto) & ksq;
+      }
+    }
+  }
 
+  //zobrist key of the position after m without making it, used to
+  //prefetch the child's tt entry
+  Hash Board::keyAfter (Move m) {
+    Square from = m.from_sq();
+    Square to = m.to_sq();
+    Piece pc = data[from];
+    Piece captured = data[to];
+    Color us = turn;
+    Hash k = key ^ colorhash() ^ piecehash(pc, from);
+
+    if (captured != NO_PIECE)
+      k ^= piecehash(captured, to);
+
+    switch (m.type_of()) {
+      case PROMOTION :
+        k ^= piecehash(make_piece(us, m.promotion_type()), to);
+        break;
+      case EN_PASSANT :
+        k ^= piecehash(pc, to) ^ piecehash(~pc, to - pawn_push(us));
+        break;
+      case CASTLING : {
+        Square rfrom = to > from ? to + EAST : to + WEST + WEST;
+        Square rto = to > from ? to + WEST : to + EAST;
+        Piece rook = make_piece(us, ROOK);
+        k ^= piecehash(pc, to) ^ piecehash(rook, rfrom) ^ piecehash(rook, rto);
+        break;
+      }
+      default :
+        k ^= piecehash(pc, to);
+    }
+
+    if (Enpassant != Sq0)
+      k ^= ephash(Enpassant);
+    if (type_of(pc) == PAWN && distance(from, to) == 2)
+      k ^= ephash(from + pawn_push(us));
+
+    uint8_t rights = CastleRights;
+    if (type_of(pc) == KING)
+      rights &= us == WHITE ? ~WHITE_CASTLING : ~BLACK_CASTLING;
+    for (Square s : {from, to}) {
+      if (s == a1) rights &= ~WHITE_OOO;
+      if (s == h1) rights &= ~WHITE_OO;
+      if (s == a8) rights &= ~BLACK_OOO;
+      if (s == h8) rights &= ~BLACK_OO;
+    }
+    if (rights != CastleRights)
+      k ^= castlehash(CastleRights) ^ castlehash(rights);
+
+    return k;
   }
 
+  //would the generator emit m here, for moves coming from the tt or the
+  //killer table that may belong to another position
+  bool Board::isPseudoLegal (Move m) {
+    if (!m.is_ok())
+      return false;
+
+    Square from = m.from_sq();
+    Square to = m.to_sq();
+    Piece pc = data[from];
 
+    if (pc == NO_PIECE || color_of(pc) != turn || (Occupancy[turn] & to))
+      return false;
 
+    //only promotions carry promotion bits
+    if (m.type_of() != PROMOTION && m.promotion_type() != KNIGHT)
+      return false;
+
+    PieceType pt = type_of(pc);
+    Rank promotionRank = turn == WHITE ? RANK_8 : RANK_1;
+
+    switch (m.type_of()) {
+      case CASTLING :
+        return pt == KING && from == (turn == WHITE ? e1 : e8)
+            && ((turn == WHITE ? castlingMoves<WHITE>(*this) : castlingMoves<BLACK>(*this)) & to);
+
+      case EN_PASSANT :
+        return pt == PAWN && Enpassant != Sq0 && to == Enpassant && (pawn_attacks_bb(turn, from) & to);
+
+      case PROMOTION :
+        return pt == PAWN && rank_of(to) == promotionRank && (pieceAttacks(*this, PAWN, from) & to);
+
+      default :
+        if (pt == PAWN) {
+          Bitboard ep = Enpassant != Sq0 ? square_bb(Enpassant) : 0;
+          return rank_of(to) != promotionRank && (pieceAttacks(*this, PAWN, from) & ~ep & to);
+        }
+        if (pt == KING)
+          return PsudoAttacks[KING][from] & to;
+        return pieceAttacks(*this, pt, from) & to;
+    }
+  }
+
+  //m must be pseudo legal, true when it does not leave our king attacked
+  bool Board::isLegal (Move m) {
+    Square from = m.from_sq();
+    Square to = m.to_sq();
+    Color us = turn, them = ~turn;
+    Square ksq = getKingSq(us);
+
+    if (m.type_of() == EN_PASSANT) {
+      Square capsq = to - pawn_push(us);
+      Bitboard occupied = (Occupancy[2] ^ from ^ capsq) | to;
+      return !(attackersTo(ksq, occupied) & Occupancy[them] & ~square_bb(capsq));
+    }
+
+    //castling path was checked against attacks already
+    if (m.type_of() == CASTLING)
+      return true;
+
+    if (type_of(data[from]) == KING)
+      return !attackedBy(them, to, Occupancy[2] ^ from);
+
+    //a non king move has to deal with a single checker
+    if (ci.checkers) {
+      if (more_than_one(ci.checkers))
+        return false;
+      Square checker = lsb(ci.checkers);
+      if (!((BetweenBB[ksq][checker] | ci.checkers) & to))
+        return false;
+    }
+
+    return !(ci.blockersForKing[us] & from) || aligned(from, to, ksq);
+  }
 
   Hash Board::compute_hash () {
     Hash h = 0;
@@ -412,4 +774,30 @@ namespace Leaf {
 
     return h;
   }
+
+  Hash Board::compute_pawn_key () {
+    Hash h = 0;
+    for (Piece p : {W_PAWN, B_PAWN}) {
+      Bitboard pawns = piecebb[p];
+      while (pawns)
+        h ^= piecehash(p, pop_lsb(pawns));
+    }
+    return h;
+  }
+
+  Hash Board::compute_material_key () {
+    Hash h = 0;
+    for (int p = W_PAWN; p <= B_KING; p++)
+      for (int cnt = 0; cnt < popcount(piecebb[p]); cnt++)
+        h ^= materialhash(Piece(p), cnt);
+    return h;
+  }
+
+  //incremental keys against a full recompute, checked after every move
+  //in builds with VERIFY_KEYS
+  bool Board::keysOk () {
+    return key == compute_hash()
+        && pawnKey == compute_pawn_key()
+        && materialKey == compute_material_key();
+  }
 }
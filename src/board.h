@@ -2,21 +2,31 @@
 #include "types.h"
 #include "bitboard.h"
 #include "hash.h"
+#include "die.h"
 
+#include <memory>
 #include <string>
+#include <string_view>
 
 namespace Leaf {
-  class Board {
+  constexpr int MAX_FEN = 128;
+
+  //hot state (key, history top, side, rights, occupancy) shares the first
+  //cache line, piece bitboards take the next two and the mailbox the
+  //fourth. pawn and material keys, the move counter, check info and the
+  //history owner follow, 448 bytes in all. the state history itself lives
+  //outside the board so a copy never drags it along
+  class alignas(64) Board {
     public:
-    Bitboard piecebb[PIECE_NB];
-    Bitboard Occupancy[3];
-    Piece data[SQUARE_NB];
-
-    Hash key;
-    Color turn;
-    uint8_t CastleRights;
-    Square Enpassant;
-    int halfMove;
+    //checkers of the side to move, pieces shielding each king (and the
+    //sliders pinning them) and the squares each piece type of the side to
+    //move would give check from. rebuilt by setCheckInfo after every move
+    struct CheckInfo {
+      Bitboard checkers;
+      Bitboard blockersForKing[COLOR_NB];
+      Bitboard pinners[COLOR_NB];
+      Bitboard checkSquares[PIECE_TYPE_NB];
+    };
 
     struct State {
       Hash key;
@@ -24,20 +34,96 @@ namespace Leaf {
       Square Enpassant;
       int halfMove;
       Piece Captured;
+      CheckInfo ci;
     };
-    std::vector<State> history;
-    
+
+    //view of the state history, copies of a board share the storage and
+    //push past the parent's top, dropping a copy pops its moves for free
+    struct StateStack {
+      State* data = nullptr;
+      int count = 0;
+
+      //checked in every build, a game plus a search that outgrow the
+      //stack would otherwise write past the end of it
+      inline void push_back (const State& st) {
+        if (count >= MAX_GAME_PLY + MAX_PLY)
+          die("state stack overflow");
+        data[count++] = st;
+      }
+      inline void pop_back () { count--; }
+      inline State& back () { return data[count - 1]; }
+      inline void clear () { count = 0; }
+      inline int size () const { return count; }
+      inline State& operator[] (int i) { return data[i]; }
+    };
+
+    //owns the history of a board, allocated on its first move. a copy of
+    //the board starts without one, see child() and fork()
+    struct HistoryStorage {
+      std::unique_ptr<State[]> states;
+
+      HistoryStorage () = default;
+      HistoryStorage (const HistoryStorage&) {}
+      HistoryStorage (HistoryStorage&&) = default;
+      HistoryStorage& operator= (HistoryStorage&&) = default;
+    };
+
+    Hash key;
+    StateStack history;
+    Color turn;
+    uint8_t CastleRights;
+    Square Enpassant;
+    int halfMove;
+    Bitboard Occupancy[3];
+
+    Bitboard piecebb[PIECE_NB];
+    Piece data[SQUARE_NB];
+    //only depend on the pieces, so make/unmake keep them exact without
+    //a snapshot
+    Hash pawnKey;
+    Hash materialKey;
+    int fullMove;
+    CheckInfo ci;
+
+    private:
+    HistoryStorage storage;
+
+    //shallow, the copy points into this board's history
+    Board (const Board&) = default;
+    //gives this board its own copy of the history
+    void ownHistory ();
 
     public:
 
+    Board () = default;
+    Board (Board&&) = default;
+    Board& operator= (const Board&) = delete;
+    //takes over the other board's history, e.g. a position built aside
+    //replacing the session board
+    Board& operator= (Board&&) = default;
+
+    //copy that pushes onto this board's history past its top, so the
+    //copy's moves pop for free when it is dropped. it must not outlive
+    //this board, copy-make children are the use
+    Board child ();
+    //copy with its own history, e.g. a root handed to another thread
+    Board fork () const;
+
     void clearBoard ();
     void init ();
-    bool loadFEN (const std::string& fen);
+    bool loadFEN (std::string_view fen);
+    int toFEN (char* out) const;
+    std::string toFEN () const;
     void print();
     void updateOccupancy ();
-    bool squareAttacked (Color by, Bitboard sqs);
+    Bitboard attacksBy (Color by);
 
     Hash compute_hash ();
+    Hash compute_pawn_key ();
+    Hash compute_material_key ();
+    bool keysOk ();
+    void setCheckInfo ();
+    Bitboard sliderBlockers (Bitboard sliders, Square s, Bitboard& pinners);
 
 
     //state functions
@@ -55,50 +141,70 @@ namespace Leaf {
     inline void setPiece (Piece p, Square s) {
       data[s] = p;
       Bitboard sb = square_bb(s);
+      materialKey ^= materialhash(p, popcount(piecebb[p]));
       piecebb[p] |= sb;
       Occupancy[colorofPiece(p)] |= sb;
       Occupancy[2] |= sb;
-      if (p != NO_PIECE)
-        key ^= piecehash(p, s);
+      key ^= piecehash(p, s);
+      if (type_of(p) == PAWN)
+        pawnKey ^= piecehash(p, s);
     }
     inline void removePiece (Piece p, Square s) {
       data[s] = NO_PIECE;
       Bitboard sb = ~square_bb(s);
       piecebb[p] &= sb;
+      materialKey ^= materialhash(p, popcount(piecebb[p]));
       Occupancy[colorofPiece(p)] &= sb;
       Occupancy[2] &= sb;
-      if (p != NO_PIECE)
-        key ^= piecehash(p, s);
+      key ^= piecehash(p, s);
+      if (type_of(p) == PAWN)
+        pawnKey ^= piecehash(p, s);
     }
     inline void removePiece (Square s) {
       Piece p = getPiece(s);
       removePiece(p, s);
     }
+    //pieces of both sides attacking s, looked up from s outwards
+    inline Bitboard attackersTo (Square s, Bitboard occupied) {
+      return (pawn_attacks_bb(BLACK, s) & piecebb[W_PAWN])
+           | (pawn_attacks_bb(WHITE, s) & piecebb[B_PAWN])
+           | (PsudoAttacks[KNIGHT][s] & (piecebb[W_KNIGHT] | piecebb[B_KNIGHT]))
+           | (attacks_bb<ROOK>(s, occupied) & (piecebb[W_ROOK] | piecebb[B_ROOK] | piecebb[W_QUEEN] | piecebb[B_QUEEN]))
+           | (attacks_bb<BISHOP>(s, occupied) & (piecebb[W_BISHOP] | piecebb[B_BISHOP] | piecebb[W_QUEEN] | piecebb[B_QUEEN]))
+           | (PsudoAttacks[KING][s] & (piecebb[W_KING] | piecebb[B_KING]));
+    }
+    inline Bitboard attackersTo (Square s) {
+      return attackersTo(s, Occupancy[2]);
+    }
+    //same for one side only, stops at the first piece type that hits
+    inline bool attackedBy (Color by, Square s, Bitboard occupied) {
+      Bitboard queens = piecebb[make_piece(by, QUEEN)];
+      return (pawn_attacks_bb(~by, s) & piecebb[make_piece(by, PAWN)])
+          || (PsudoAttacks[KNIGHT][s] & piecebb[make_piece(by, KNIGHT)])
+          || (PsudoAttacks[KING][s] & piecebb[make_piece(by, KING)])
+          || (attacks_bb<BISHOP>(s, occupied) & (piecebb[make_piece(by, BISHOP)] | queens))
+          || (attacks_bb<ROOK>(s, occupied) & (piecebb[make_piece(by, ROOK)] | queens));
+    }
+    //multi square variant, e.g. the king's path when castling
+    inline bool squareAttacked (Color by, Bitboard sqs) {
+      while (sqs)
+        if (attackedBy(by, pop_lsb(sqs), Occupancy[2]))
+          return true;
+      return false;
+    }
+
     inline bool squareEmpty (Square s) {
       return data[s] == NO_PIECE;
     }
+    inline bool inCheck () {
+      return ci.checkers;
+    }
+    //true when the side that just moved left its king attacked
     inline bool kingInCheck () {
-      Color by; Bitboard king;
-
-      if (turn == BLACK) {
-        by = BLACK;
-        king = piecebb[W_KING];
-      } else {
-        by = WHITE;
-        king = piecebb[B_KING];
-      }
-      return squareAttacked(by, king);
+      return attackedBy(turn, getKingSq(~turn), Occupancy[2]);
     }
     inline bool kingInCheck (Color c) {
-      Color by; Bitboard king;
-      if (c == WHITE) {
-        king = piecebb[W_KING];
-        by = BLACK;
-      } else {
-        king = piecebb[B_KING];
-        by = WHITE;
-      }
-      return squareAttacked(by, king);
+      return attackedBy(~c, getKingSq(c), Occupancy[2]);
     }
 
     //
@@ -110,13 +216,10 @@ namespace Leaf {
       if (m.type_of() == EN_PASSANT) return PAWN;
       else return type_of(data[m.to_sq()]);
     }
-    inline bool givesCheck (Move& m) {
-      Board::State st;
-      MakeMove(m, st);
-      bool check = kingInCheck(turn);
-      UnmakeMove(m);
-      return check;
-    }
+    bool givesCheck (Move m);
+    Hash keyAfter (Move m);
+    bool isPseudoLegal (Move m);
+    bool isLegal (Move m);
 
 
     void moveRooks (Square to, int recover = -1);
@@ -133,5 +236,10 @@ namespace Leaf {
 
 
   };
+
+  static_assert(sizeof(Board) == 7 * 64, "board layout changed, check the cache line comment");
+
+  //attack maps of both sides for a batch of positions (dataset processing)
+  void attackMaps (Board boards[], int n, Bitboard maps[][COLOR_NB]);
 }
 
@@ -2,42 +2,150 @@
 #include "board.h"
 #include "evaluation.h"
 #include "movegen.h"
+#include "movepick.h"
 #include "types.h"
 #include <chrono>
 #include <cmath>
 #include <ctime>
+#include <thread>
 #include <vector>
 
 namespace Leaf {
 
-  //time controls
-  using Clock = std::chrono::steady_clock;
-  Clock::time_point startSearch;
-  int timeMs;
-  std::atomic <bool> stopSearch(false);
+  //a share of the remaining time per move plus most of the increment, the
+  //hard limit allows a few times that to finish an iteration that
+  //matters but never more than half the clock, even on the last move
+  //before the time control or with an increment as big as what is left.
+  //the soft limit stays at most half the hard one so an iteration started
+  //just before it has room to finish
+  void TimeManager::init (const SearchLimits& limits, Color us) {
+    softMs = hardMs = 0;
+    if (limits.infinite)
+      return;
+    if (limits.movetime > 0) {
+      softMs = hardMs = std::max(limits.movetime - MoveOverhead, 1);
+      return;
+    }
+
+    int time = us == WHITE ? limits.wtime : limits.btime;
+    int inc = us == WHITE ? limits.winc : limits.binc;
+    if (time <= 0)
+      return;
+    int left = std::max(time - MoveOverhead, 1);
+    int movesToGo = limits.movestogo > 0 ? std::min(limits.movestogo, 50) : 30;
+    //0 would mean no limit, a nearly flat clock still gets 1 ms
+    hardMs = std::max(std::min(left / movesToGo * 4 + inc, left / 2), 1);
+    softMs = std::max(std::min(left / movesToGo + inc * 3 / 4, hardMs / 2), 1);
+  }
 
-  inline bool timeUp () {
-    if (timeMs <= 0)
+  Search::Search (TT& tt) : tt(tt), main(std::make_unique<SearchThread>(*this)) {
+    main->clear();
+    main->readsClock = true;
+  }
+
+  inline int64_t Search::elapsed () const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startSearch).count();
+  }
+
+  //all threads, a go nodes limit caps the whole search and not only the
+  //main thread's share of it
+  uint64_t Search::countNodes () const {
+    uint64_t n = main->nodes.load(std::memory_order_relaxed);
+    for (auto& w : workers)
+      n += w->nodes.load(std::memory_order_relaxed);
+    return n;
+  }
+
+  //the clock of a ponder search starts when the main thread first sees
+  //ponderhit
+  bool Search::clockRunning () {
+    if (!clockPaused)
+      return true;
+    if (ponderhitIssued.load(std::memory_order_relaxed) < current)
       return false;
-    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startSearch).count() >= timeMs;
+    clockPaused = false;
+    startSearch = Clock::now();
+    return true;
+  }
+
+  void Search::checkLimits (bool clock) {
+    if ((limits.nodes && countNodes() >= limits.nodes) || (clock && time.hardMs > 0 && clockRunning() && elapsed() >= time.hardMs))
+      limitHit.store(true, std::memory_order_relaxed);
+  }
+
+  //only flags, the clock is read by the main thread in poll()
+  inline bool Search::searchStopped () const {
+    return stopIssued.load(std::memory_order_relaxed) >= current || stopHelpers.load(std::memory_order_relaxed)
+        || limitHit.load(std::memory_order_relaxed);
   }
 
-  //Gloabl tables
-  PV pv;
-  Killer killer;
-  TT transposition;
-  int SEARCHED_NODES;
+  void Search::clear () {
+    tt.clear();
+    main->clear();
+  }
+
+  void SearchThread::clear () {
+    pv.clear();
+    killer.clear();
+    history.clear();
+    rootScore = 0;
+    pollCountdown = PollInterval;
+  }
+
+  inline void SearchThread::poll () {
+    if (--pollCountdown <= 0) {
+      pollCountdown = PollInterval;
+      search.checkLimits(readsClock);
+    }
+  }
 
-  int NegaMax (Board& b, int depth, int ply, int alpha, int beta) {
-    if (stopSearch.load(std::memory_order_relaxed) || timeUp())
+  //plays m and searches the child, on a board copy when built with COPY_MAKE
+  inline int SearchThread::searchChild (Board& b, Move m, int depth, int ply, int alpha, int beta) {
+    //the tt is far too big for cache, start loading the child's entry so
+    //the miss overlaps with the make
+    if (search.ttPrefetch)
+      search.tt.prefetch(b.keyAfter(m));
+
+    Board::State state;
+#if defined(COPY_MAKE)
+    Board child = b.child();
+    child.MakeMove(m, state);
+    return -NegaMax(child, depth, ply + 1, -beta, -alpha);
+#else
+    b.MakeMove(m, state);
+    int score = -NegaMax(b, depth, ply + 1, -beta, -alpha);
+    b.UnmakeMove(m);
+    return score;
+#endif
+  }
+
+  inline void SearchThread::updatePV (int ply, Move m) {
+    pv.Table[ply][0] = m;
+    for (int j = 0; j < pv.length[ply + 1]; j++) {
+      pv.Table[ply][j + 1] = pv.Table[ply + 1][j];
+    }
+    pv.length[ply] = pv.length[ply + 1] + 1;
+  }
+
+  inline void SearchThread::updateKillers (Board& b, int ply, int depth, Move m) {
+    if (!b.isCapture(m)) {
+      killer.Table[1][ply] = killer.Table[0][ply];
+      killer.Table[0][ply] = m;
+      history.update(b.turn, m, depth);
+    }
+  }
+
+  int SearchThread::NegaMax (Board& b, int depth, int ply, int alpha, int beta) {
+    if (search.searchStopped())
       return 0;
 
-    SEARCHED_NODES++;
+    countNode();
+    poll();
 
     int ttscore;
     int alphaOrig = alpha;
     Bound iflag;
-    if (transposition.probe(b.key, depth, ttscore, alpha, beta, iflag)) {
+    if (search.tt.probe(b.key, depth, ttscore, alpha, beta, iflag)) {
       if (iflag == BOUND_EXACT) return ttscore;
       else if (iflag == BOUND_LOWER && ttscore > alpha) alpha = ttscore;
       else if (iflag == BOUND_UPPER && ttscore < beta) beta = ttscore;
@@ -49,7 +157,7 @@ namespace Leaf {
       return VALUE_DRAW;
 
     //Null Move Pruning
-    if (depth >= 3 && !b.kingInCheck(b.turn)) {
+    if (depth >= 3 && !b.inCheck()) {
       Board::State null;
       b.MakeNullMove(null);
       int nullscore = -NegaMax(b, depth -2, ply + 1, -beta, -beta + 1);
@@ -58,234 +166,315 @@ namespace Leaf {
         return nullscore;
     }
 
-    MoveList list;
-    LegalMoves(b, list);
-    Move mtt = transposition.getMove(b.key);
+    if (depth == 0) {
+      if (countLegal(b) == 0)
+        return b.inCheck() ? -VALUE_MATE + ply : VALUE_DRAW;
+      return quiesciene(b, alpha, beta, ply);
+    }
+
+    Move mtt = search.tt.getMove(b.key);
     Move mpv = (pv.length[ply] > 0) ? pv.Table[ply][0] : Move::none();
     Move mk1 = killer.Table[0][ply];
     Move mk2 = killer.Table[1][ply];
-    sortMoveList(b, list, mtt, mpv, mk1, mk2);
-
-    if (list.count == 0) {
-      if (b.kingInCheck(b.turn))
-        return -VALUE_MATE + ply;
-      else return VALUE_DRAW;
-    }
-
-    if (depth == 0)
-      return quiesciene(b, alpha, beta);
 
     int score;
     int bestScore = -VALUE_INFINITE;
     Move bestMove = Move::none();
 
-    for (int i = 0; i < list.count; i++) {
-
+    //moves come out stage by stage, a cutoff on the tt move never
+    //generates anything
+    MovePicker mp(b, mtt, mk1, mk2, history);
+    int moveCount = 0;
+    Move m;
+    while ((m = mp.next())) {
       int newDepth = depth - 1;
 
-      if (i >= 3 && !b.givesCheck(list.data[i]) && (!b.isCapture(list.data[i]) && list.data[i] != mpv && list.data[i] != mk1 && list.data[i] != mk2))
+      if (moveCount >= 3 && !b.givesCheck(m) && (!b.isCapture(m) && m != mpv && m != mk1 && m != mk2))
         newDepth -= 1;
       if (newDepth < 0)
         newDepth = 0;
-      Board::State state;
-      b.MakeMove(list.data[i], state);
-      score = -NegaMax(b, newDepth, ply + 1, -beta, -alpha);
-      b.UnmakeMove(list.data[i]);
+      moveCount++;
+      //pvs: after the first move only prove that nothing beats alpha, a
+      //move that does gets searched again with the real window
+      if (search.pvs && moveCount > 1) {
+        score = searchChild(b, m, newDepth, ply, alpha, alpha + 1);
+        if (score > alpha && score < beta)
+          score = searchChild(b, m, newDepth, ply, alpha, beta);
+      }
+      else
+        score = searchChild(b, m, newDepth, ply, alpha, beta);
      
-      if (stopSearch.load(std::memory_order_relaxed) || timeUp())
+      if (search.searchStopped())
         return 0;
 
       if (score > bestScore) {
         bestScore = score;
-        bestMove = list.data[i];
-
-        pv.Table[ply][0] = bestMove;
-        for (int j = 0; j < pv.length[ply + 1]; j++) {
-          pv.Table[ply][j + 1] = pv.Table[ply + 1][j];
-        }
-        pv.length[ply] = pv.length[ply + 1] + 1;
+        bestMove = m;
+        updatePV(ply, m);
       }
       if (score >= alpha) {
         alpha = score;
       }
       if (alpha >= beta) {
-        if (!b.isCapture(list.data[i])) {
-          killer.Table[1][ply] = killer.Table[0][ply];
-          killer.Table[0][ply] = list.data[i];
-        }
+        updateKillers(b, ply, depth, m);
         break;
       }
     }
+
+    if (moveCount == 0)
+      return b.inCheck() ? -VALUE_MATE + ply : VALUE_DRAW;
+
     Bound flag;
     if (bestScore <= alphaOrig) flag = BOUND_UPPER;
     else if (bestScore >= beta) flag = BOUND_LOWER;
     else flag = BOUND_EXACT;
 
-    transposition.store(b.key, depth, bestScore, flag, bestMove);
+    search.tt.store(b.key, depth, bestScore, flag, bestMove);
 
     return bestScore;
   }
 
-  Move FindBestMove (Board& b, int depth, int alpha, int beta) {
+  Move SearchThread::FindBestMove (Board& b, int depth, int alpha, int beta) {
     
     Move bestMove = Move::none();
-    if (stopSearch.load(std::memory_order_relaxed) || timeUp())
+    if (search.searchStopped())
       return bestMove;
 
     int bestScore = -VALUE_INFINITE;
+    int alphaOrig = alpha;
 
     int ttscore; Bound flag;
-    Move ttmove = transposition.getMove(b.key);
-    if (transposition.probe(b.key, depth, ttscore, alpha, beta, flag)) {
+    Move ttmove = search.tt.getMove(b.key);
+    if (search.tt.probe(b.key, depth, ttscore, alpha, beta, flag)) {
+      rootScore = ttscore;
       if (flag == BOUND_EXACT) return ttmove;
       else if (flag == BOUND_LOWER && ttscore > alpha) alpha = ttscore;
       else if (flag == BOUND_UPPER && ttscore < beta) beta = ttscore;
       if (alpha >= beta) return ttmove;
     }
 
-    MoveList list;
-    LegalMoves(b, list);
-    Move mpv = (pv.length[0] > 0) ? pv.Table[0][0] : Move::none();
-    Move mk1 = killer.Table[0][0];
-    Move mk2 = killer.Table[1][0];
-    sortMoveList(b, list, ttmove, mpv, mk1, mk2);
-    Move none = Move::none();
-
+    MovePicker mp(b, ttmove, killer.Table[0][0], killer.Table[1][0], history);
 
     int score;
-    for (int i = 0; i < list.count; i++) {
-      Board::State state;
-      b.MakeMove(list.data[i], state);
-      score = -NegaMax(b, depth - 1, 1, -beta, -alpha);
-      b.UnmakeMove(list.data[i]);
+    int moveCount = 0;
+    Move m;
+    while ((m = mp.next())) {
+      moveCount++;
+      if (search.pvs && moveCount > 1) {
+        score = searchChild(b, m, depth - 1, 0, alpha, alpha + 1);
+        if (score > alpha && score < beta)
+          score = searchChild(b, m, depth - 1, 0, alpha, beta);
+      }
+      else
+        score = searchChild(b, m, depth - 1, 0, alpha, beta);
 
-      if (stopSearch.load(std::memory_order_relaxed) || timeUp())
+      if (search.searchStopped())
         return bestMove;
 
       if (score > bestScore) {
         bestScore = score;
-        bestMove = list.data[i];
-
-        pv.Table[0][0] = bestMove;
-        for (int j = 0; j < pv.length[0 + 1]; j++) {
-          pv.Table[0][j + 1] = pv.Table[0 + 1][j];
-        }
-        pv.length[0] = pv.length[0 + 1] + 1;
+        bestMove = m;
+        updatePV(0, bestMove);
       }
       if (score >= alpha) {
         alpha = score;
       }
       if (alpha >= beta) {
-        if (!b.isCapture(list.data[i])) {
-          killer.Table[1][0] = killer.Table[0][0];
-          killer.Table[0][0] = list.data[i];
-        }
+        updateKillers(b, 0, depth, m);
         break;
       }
     }
-    transposition.store(b.key, depth, bestScore, BOUND_EXACT, bestMove);
-
+    //an aspiration window can fail at the root too, only a score inside
+    //the window is exact
+    Bound rootFlag;
+    if (bestScore <= alphaOrig) rootFlag = BOUND_UPPER;
+    else if (bestScore >= beta) rootFlag = BOUND_LOWER;
+    else rootFlag = BOUND_EXACT;
+    search.tt.store(b.key, depth, bestScore, rootFlag, bestMove);
+
+    rootScore = bestScore;
     return bestMove;
   }
 
+  //searches a window around the last iteration's score. the side that
+  //fails is widened, doubling each time, until the score lands inside
+  Move SearchThread::aspiration (Board& b, int depth) {
+    if (!search.aspiration || depth < AspirationDepth)
+      return FindBestMove(b, depth, -VALUE_INFINITE, VALUE_INFINITE);
+
+    int delta = AspirationWindow;
+    int alpha = std::max(rootScore - delta, -VALUE_INFINITE);
+    int beta = std::min(rootScore + delta, VALUE_INFINITE);
+    while (true) {
+      Move m = FindBestMove(b, depth, alpha, beta);
+      if (search.searchStopped())
+        return m;
+
+      delta *= 2;
+      if (rootScore <= alpha && alpha > -VALUE_INFINITE)
+        alpha = std::max(rootScore - delta, -VALUE_INFINITE);
+      else if (rootScore >= beta && beta < VALUE_INFINITE)
+        beta = std::min(rootScore + delta, VALUE_INFINITE);
+      else
+        return m;
+    }
+  }
+
+
+  //under the mutex so a waiting search cannot miss the signal between
+  //its check and its wait
+  void Search::stop () {
+    {
+      std::lock_guard<std::mutex> lock(signalMutex);
+      stopIssued.store(issued.load());
+    }
+    signal.notify_all();
+  }
 
-  Move SearchMove (Board& b, int maxDepth) {
-    stopSearch.store(false);
+  void Search::ponderhit () {
+    {
+      std::lock_guard<std::mutex> lock(signalMutex);
+      ponderhitIssued.store(issued.load());
+    }
+    signal.notify_all();
+  }
+
+  Move Search::SearchMove (Board& b, const SearchLimits& l, uint64_t id) {
+    current = id ? id : issue();
+    stopHelpers.store(false);
+    limitHit.store(false);
     startSearch = Clock::now();
+    limits = l;
+    clockPaused = limits.ponder;
+    time.init(limits, b.turn);
+    int maxDepth = std::min(limits.depth, MaxSearchDepth);
 
-    Move none = Move::none();
     Move bestMove = Move::none();
+    Move partial = Move::none();
+
+    main->clear();
+    main->nodes.store(0);
+
+    //helper boards get their own history before the main thread starts
+    //pushing onto the shared one
+    int helperCount = std::max(threads.load() - 1, 0);
+    std::vector<Board> boards;
+    boards.reserve(helperCount);
+    workers.clear();
+    for (int i = 0; i < helperCount; i++) {
+      boards.push_back(b.fork());
+      workers.push_back(std::make_unique<SearchThread>(*this));
+      workers.back()->clear();
+    }
+    //lazy smp helpers: the same iterative deepening on their own board and
+    //tables, every other helper a ply ahead so the threads spread over
+    //depths. they only feed the shared tt, the main thread picks the move
+    auto helperSearch = [this, maxDepth] (SearchThread& t, Board& hb, int id) {
+      for (int depth = 1 + (id & 1); depth <= maxDepth; depth++) {
+        t.aspiration(hb, depth);
+        if (searchStopped())
+          break;
+      }
+    };
+    std::vector<std::thread> helpers;
+    for (int i = 0; i < helperCount; i++)
+      helpers.emplace_back(helperSearch, std::ref(*workers[i]), std::ref(boards[i]), i + 1);
 
-    //clear tables
-    pv.clear();
-    killer.clear();
-
-    SEARCHED_NODES = 0;
     for (int depth = 1; depth <= maxDepth; depth++) {
 
-      Move m = FindBestMove(b, depth, -VALUE_INFINITE, VALUE_INFINITE);
+      Move m = main->aspiration(b, depth);
 
-      if (stopSearch.load(std::memory_order_relaxed) || timeUp())
-        return bestMove;
+      if (searchStopped()) {
+        partial = m;
+        break;
+      }
       bestMove = m;
+      //the next iteration would most likely not finish before the hard
+      //limit, don't start it
+      if (time.softMs > 0 && clockRunning() && elapsed() >= time.softMs)
+        break;
+    }
+
+    //out of depth or nodes, but the gui expects no bestmove before stop,
+    //or while its move is being pondered
+    if (limits.infinite || limits.ponder) {
+      std::unique_lock<std::mutex> lock(signalMutex);
+      signal.wait(lock, [this] {
+        return stopIssued.load() >= current || (!limits.infinite && ponderhitIssued.load() >= current);
+      });
+    }
+
+    //stopped inside the first iteration, still play something legal
+    if (!bestMove)
+      bestMove = partial;
+    if (!bestMove) {
+      MoveList list;
+      LegalMoves(b, list);
+      if (list.count > 0)
+        bestMove = list.data[0];
     }
 
-    std::cout << "Searched nodes->" << SEARCHED_NODES << std::endl;
+    stopHelpers.store(true);
+    for (std::thread& t : helpers)
+      t.join();
+    searchedNodes = countNodes();
+    workers.clear();
+
+    std::cout << "Searched nodes->" << searchedNodes << std::endl;
     return bestMove;
   }
   
-  int quiesciene(Board &b, int alpha, int beta) {
+  int SearchThread::quiesciene (Board& b, int alpha, int beta, int ply) {
+    //the qsearch can blow up on its own, keep watching the clock in it
+    poll();
+    if (search.searchStopped())
+      return 0;
 
-    int stand_pat = Eval(b);
-    if (stand_pat >= beta)
-      return stand_pat;
+    //in check there is no standing pat, every evasion gets searched
+    bool inCheck = b.inCheck();
+    if (!inCheck) {
+      int stand_pat = Eval(b);
+      if (stand_pat >= beta)
+        return stand_pat;
 
-    if (alpha < stand_pat)
-      alpha = stand_pat;
+      if (alpha < stand_pat)
+        alpha = stand_pat;
+    }
 
     int score = -INFINITY;
 
-    MoveList list;
-    LegalMoves(b, list);
+    MovePicker mp(b);
 
     Board::State state;
-    for (int i = 0; i < list.count; i++) {
-      if (!b.isCapture(list.data[i]) && !b.givesCheck(list.data[i]))
-        continue;
-    
-      b.MakeMove(list.data[i], state);
-      score = -quiesciene(b, -beta, -alpha);
-      b.UnmakeMove(list.data[i]);
+    Move m;
+    int moveCount = 0;
+    while ((m = mp.next())) {
+      moveCount++;
+#if defined(COPY_MAKE)
+      Board child = b.child();
+      child.MakeMove(m, state);
+      score = -quiesciene(child, -beta, -alpha, ply + 1);
+#else
+      b.MakeMove(m, state);
+      score = -quiesciene(b, -beta, -alpha, ply + 1);
+      b.UnmakeMove(m);
+#endif
 
       if (score > alpha) alpha = score;
       if (score >= beta) return beta;
     }
+    if (inCheck && moveCount == 0)
+      return -VALUE_MATE + ply;
     return alpha;
   }
 
 
-  std::vector<Move> readPV() {
+  std::vector<Move> Search::readPV () const {
     std::vector<Move> pvs;
-    for (int i = 0; i < pv.length[0]; i++) {
-      pvs.push_back(pv.Table[0][i]);
+    for (int i = 0; i < main->pv.length[0]; i++) {
+      pvs.push_back(main->pv.Table[0][i]);
     }
     return pvs;
   }
-  inline bool capturegood (Board& b, Move& m) {
-    Square x = m.from_sq();
-    Square y = m.to_sq();
-    Piece attacker = b.data[x];
-    Piece victim = b.data[y];
-    return PieceValue[victim] + PawnValue >=  PieceValue[attacker];
-  }
-
-
-
-  int moveValue (Board& b, Move& m,Move& tt,  Move& pv, Move& k1, Move& k2) {
-    int score = 0;
-    if (m == tt) return 100000;
-    if (m == pv) return 9999;
-    if (m == k1) return 8000;
-    if (m == k2) return 700;
-    if (m.type_of() == EN_PASSANT) score += 500;
-    else if (b.isCapture(m) && capturegood(b, m)) score += 650;
-    else if (b.isCapture(m) && !capturegood(b, m)) score += 200;
-    if (b.givesCheck(m)) score += 600;
-
-    return score;
-  }
-  void sortMoveList (Board& b, MoveList& list, Move& tt, Move& pv, Move& k1, Move& k2) {
-    for (int i = 0; i < list.count - 1; i++) {
-      for (int j = i + 1; j < list.count; j++) {
-        if (moveValue(b, list.data[i], tt, pv, k1, k2) < moveValue(b, list.data[j], tt, pv, k1, k2)) {
-          Move temp = list.data[i];
-          list.data[i] = list.data[j];
-          list.data[j] = temp;
-          //std::swap(list.data[i], list.data[j]);
-        }
-      }
-    }
-  }
-
 
 }
@@ -6,35 +6,67 @@
 #include "evaluation.h"
 #include "die.h"
 #include "errosion.h"
+#include "movepick.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cstdint>
+#include <memory>
 #include <functional>
 #include <vector>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 namespace Leaf {
 
-  //Transposition table
+  //Transposition table. an entry is two words, the key is stored xored
+  //with the packed data so a probe racing a store from another search
+  //thread sees a mismatched key instead of a half written entry
   struct TTEntry {
-    Hash key;
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> data;
+  };
+
+  //move, bound, depth and score packed into one word
+  struct TTData {
+    Move best;
+    Bound flags;
     int depth;
     int score;
-    Bound flags;
-    Move best;
+
+    static inline uint64_t pack (Move best, Bound flags, int depth, int score) {
+      return uint64_t(best.raw()) | uint64_t(flags) << 16 | uint64_t(uint8_t(depth)) << 24
+           | uint64_t(uint32_t(score)) << 32;
+    }
+    static inline TTData unpack (uint64_t d) {
+      return {Move(uint16_t(d)), Bound((d >> 16) & 3), int((d >> 24) & 0xFF), int(int32_t(d >> 32))};
+    }
   };
 
   class TT {
-    std::vector<TTEntry> TTtable;
+    std::unique_ptr<TTEntry[]> TTtable;
     size_t TTmask;
 
     public:
-    TT(size_t size = 1 << 23) {
-      TTtable.resize(size);
-      TTmask = size - 1;
+    TT(size_t size = 1 << 23) : TTtable(new TTEntry[size]), TTmask(size - 1) {
+      clear();
     }
     void store (Hash key, int depth, int score, Bound flags, Move best);
     bool probe (Hash key, int depth, int& score, int alpha, int beta, Bound& flag);
     Move getMove (Hash key);
+
+    void clear () {
+      for (size_t i = 0; i <= TTmask; i++) {
+        TTtable[i].key.store(0, std::memory_order_relaxed);
+        TTtable[i].data.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    //pulls the entry of key towards the cache ahead of the probe
+    void prefetch (Hash key) {
+      __builtin_prefetch(&TTtable[key & TTmask]);
+    }
   };
 
   struct PV {
@@ -58,39 +90,182 @@ namespace Leaf {
     }
   };
 
-  extern std::atomic<bool> stopSearch;
+  class Search;
+
+  //half width of the first aspiration window, and the first iteration that
+  //uses one, shallower scores jump around too much to centre on
+  constexpr int AspirationWindow = 50;
+  constexpr int AspirationDepth = 4;
+
+  //deepest iteration of a search without a depth limit
+  constexpr int MaxSearchDepth = 64;
+  //nodes of one thread between two checks of the clock or the node limit
+  constexpr int PollInterval = 1024;
+  //kept back from the clock for the gui and the pipe, in ms
+  constexpr int MoveOverhead = 30;
+
+  //limits of one go command, 0 is no limit
+  struct SearchLimits {
+    int depth = MaxSearchDepth;
+    int wtime = 0, btime = 0;
+    int winc = 0, binc = 0;
+    int movestogo = 0;
+    int movetime = 0;
+    //summed over all threads, each checks it every PollInterval own nodes
+    uint64_t nodes = 0;
+    //no bestmove before stop, even once MaxSearchDepth is done
+    bool infinite = false;
+    //searching the expected reply on the opponent's time, the clock only
+    //starts at ponderhit
+    bool ponder = false;
+  };
 
-  Move FindBestMove (Board& b, int depth);
-  Move SearchMove(Board& b, int maxDepth);
-  int quiesciene(Board &b, int alpha, int beta);
-  void sortMoveList (Board& b, MoveList& list, Move& tt, Move& pv, Move& k1, Move& k2);
-  std::vector <Move> readPV ();
+  //turns the clock into a soft limit, after which no new iteration is
+  //started, and a hard limit at which the running one is dropped
+  struct TimeManager {
+    int softMs = 0;
+    int hardMs = 0;
+
+    void init (const SearchLimits& limits, Color us);
+  };
+
+  //tables of one search thread, the main one or a lazy smp helper
+  class SearchThread {
+    public:
+    PV pv;
+    Killer killer;
+    History history;
+    //written by the owning thread only, read relaxed by the main thread
+    //to apply the node limit to the whole search
+    std::atomic<uint64_t> nodes{0};
+    //only the main thread reads the clock, every thread checks the node
+    //limit
+    bool readsClock = false;
+    //score of the last FindBestMove, the centre of the next aspiration
+    //window
+    int rootScore = 0;
+
+    explicit SearchThread (Search& s) : search(s) {}
+    void clear ();
+    Move FindBestMove (Board& b, int depth, int alpha, int beta);
+    Move aspiration (Board& b, int depth);
+    int NegaMax (Board& b, int depth, int ply, int alpha, int beta);
+    int quiesciene (Board& b, int alpha, int beta, int ply);
+
+    private:
+    Search& search;
+
+    int searchChild (Board& b, Move m, int depth, int ply, int alpha, int beta);
+    void updatePV (int ply, Move m);
+    void updateKillers (Board& b, int ply, int depth, Move m);
+    void poll ();
+    void countNode () { nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    int pollCountdown = PollInterval;
+  };
+
+  //one search with its own threads, clock and stop flag. the tt is handed
+  //in by the owner, so searches in one process can keep separate tables
+  //or share one
+  class Search {
+    friend class SearchThread;
+
+    public:
+    TT& tt;
+    //threads per search, the main one plus lazy smp helpers. read once
+    //when a search starts, a gui may set it while one runs
+    std::atomic<int> threads{1};
+    //prefetch the child's tt entry before making a move
+    bool ttPrefetch = true;
+    //zero window searches after the first move of a node
+    bool pvs = true;
+    //search each iteration in a window around the last score
+    bool aspiration = true;
+
+    explicit Search (TT& tt);
+    //id is the one issue() handed out for the go, 0 issues a fresh one
+    Move SearchMove (Board& b, const SearchLimits& limits, uint64_t id = 0);
+    Move SearchMove (Board& b, int maxDepth, uint64_t id = 0) {
+      SearchLimits limits;
+      limits.depth = maxDepth;
+      return SearchMove(b, limits, id);
+    }
+    //forget everything learned from previous searches, e.g. for a new game
+    void clear ();
+    //ids of searches in the order the go commands came in. stop and
+    //ponderhit apply to every search issued before them, so a stop sent
+    //while the search is still queued ends it, and one sent before a go
+    //never reaches that go
+    uint64_t issue () { return issued.fetch_add(1) + 1; }
+    //safe to call from another thread while SearchMove runs
+    void stop ();
+    //the expected move was played, search on under the go ponder limits
+    void ponderhit ();
+    bool stopped (uint64_t id) const { return stopIssued.load() >= id; }
+    //nodes of the last search, all threads summed
+    uint64_t nodes () const { return searchedNodes; }
+    std::vector <Move> readPV () const;
+
+    private:
+    using Clock = std::chrono::steady_clock;
+
+    std::unique_ptr<SearchThread> main;
+    //lazy smp helpers of the running search
+    std::vector<std::unique_ptr<SearchThread>> workers;
+    SearchLimits limits;
+    TimeManager time;
+    Clock::time_point startSearch;
+    std::atomic<uint64_t> issued{0};
+    //searches with an id up to these saw stop / ponderhit
+    std::atomic<uint64_t> stopIssued{0};
+    std::atomic<uint64_t> ponderhitIssued{0};
+    //wakes a search holding its bestmove for stop or ponderhit
+    std::mutex signalMutex;
+    std::condition_variable signal;
+    //id of the running search, set before its threads start
+    uint64_t current = 0;
+    //main thread only, set while a ponder search has not seen ponderhit
+    bool clockPaused = false;
+    //set once the main thread is done, helpers never outlive its search
+    std::atomic<bool> stopHelpers{false};
+    //set once the hard time or the node limit is hit
+    std::atomic<bool> limitHit{false};
+    uint64_t searchedNodes = 0;
+
+    int64_t elapsed () const;
+    bool clockRunning ();
+    uint64_t countNodes () const;
+    void checkLimits (bool clock);
+    bool searchStopped () const;
+  };
 }
 
 namespace Leaf {
   inline void TT::store (Hash key, int depth, int score, Bound flags, Move best) {
     TTEntry& e = TTtable[key & TTmask];
+    uint64_t old = e.data.load(std::memory_order_relaxed);
+    uint64_t oldKey = e.key.load(std::memory_order_relaxed) ^ old;
 
-    if (e.depth <= depth || e.key == 0) {
-      e.key = key;
-      e.depth = depth;
-      e.score = score;
-      e.flags = flags;
-      e.best = best;
+    if (TTData::unpack(old).depth <= depth || oldKey == 0) {
+      uint64_t d = TTData::pack(best, flags, depth, score);
+      e.key.store(key ^ d, std::memory_order_relaxed);
+      e.data.store(d, std::memory_order_relaxed);
     }
   }
 
   inline bool TT::probe (Hash key, int depth, int& score, int alpha, int beta, Bound& flag) {
     TTEntry& e = TTtable[key & TTmask];
+    uint64_t d = e.data.load(std::memory_order_relaxed);
 
-    if (e.key != key)
+    if ((e.key.load(std::memory_order_relaxed) ^ d) != key)
       return false;
-    if (e.depth < depth)
+    TTData t = TTData::unpack(d);
+    if (t.depth < depth)
       return false;
-    score = e.score;
-    flag = e.flags;
+    score = t.score;
+    flag = t.flags;
 
-    switch (e.flags) {
+    switch (t.flags) {
       case BOUND_EXACT : return true;
       case BOUND_LOWER : if (score >= beta) return true; break;
       case BOUND_UPPER : if (score <= alpha) return true; break;
@@ -101,9 +276,10 @@ namespace Leaf {
 
   inline Move TT::getMove (Hash key) {
     TTEntry& e = TTtable[key & TTmask];
+    uint64_t d = e.data.load(std::memory_order_relaxed);
 
-    if (key == e.key)
-      return e.best;
+    if ((e.key.load(std::memory_order_relaxed) ^ d) == key)
+      return TTData::unpack(d).best;
     return Move::none();
   }
 
@@ -44,14 +44,15 @@ namespace Leaf {
     //threefold repitation;
     int count = 0;
     Hash currentkey = b.key;
-    for (auto it = b.history.rbegin(); it != b.history.rend(); ++it) {
-      if (it->key == currentkey)
+    for (int i = b.history.size() - 1; i >= 0; i--) {
+      const Board::State& st = b.history[i];
+      if (st.key == currentkey)
         count++;
 
       if (count == 3)
         return true;
 
-      if (it->halfMove == 0)
+      if (st.halfMove == 0)
         break;
     }
     
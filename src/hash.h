@@ -8,8 +8,29 @@ namespace Leaf {
   using Hash = uint64_t;
   void init_hash ();
 
-  Hash piecehash(Piece p, Square s);
-  Hash castlehash(uint8_t cr);
-  Hash colorhash();
-  Hash ephash(Square s);
+  //indexed directly by piece, square, rights and file. the NO_PIECE row
+  //is left zero
+  namespace Zobrist {
+    extern Hash psq[PIECE_NB][SQUARE_NB];
+    extern Hash castling[CASTLING_RIGHTS_NB];
+    extern Hash enpassant[FILE_NB];
+    extern Hash side;
+  }
+
+  inline Hash piecehash(Piece p, Square s) {
+    return Zobrist::psq[p][s];
+  }
+  inline Hash castlehash(uint8_t cr) {
+    return Zobrist::castling[cr];
+  }
+  inline Hash colorhash() {
+    return Zobrist::side;
+  }
+  inline Hash ephash(Square s) {
+    return Zobrist::enpassant[file_of(s)];
+  }
+  //material signature, one key per (piece, count) pair
+  inline Hash materialhash(Piece p, int count) {
+    return Zobrist::psq[p][count];
+  }
 }
@@ -0,0 +1,29 @@
+#include "bitboard.h"
+#include "types.h"
+
+#include <cstdio>
+#include <random>
+
+using namespace Leaf;
+
+//prints a fresh magics.h to stdout
+//usage: magicgen [seed] > src/magics.h
+int main(int argc, char* argv[]) {
+  uint64_t seed = argc > 1 ? std::stoull(argv[1]) : 0x1EAF;
+  std::mt19937_64 gen(seed);
+
+  std::printf("#pragma once\n\n#include \"types.h\"\n\n");
+  std::printf("//generated by magicgen (seed %llu), do not edit by hand\n", (unsigned long long) seed);
+  std::printf("namespace Leaf {\n");
+
+  for (PieceType pt : {BISHOP, ROOK}) {
+    std::printf("  constexpr Bitboard %s[SQUARE_NB] = {\n", pt == BISHOP ? "BishopMagics" : "RookMagics");
+    for (Square s = a1; s <= h8; ++s) {
+      Bitboard magic = Bitboards::find_magic(pt, s, gen);
+      std::printf("%s0x%016llxULL%s", file_of(s) == FILE_A ? "    " : "",
+                  (unsigned long long) magic, s == h8 ? "\n" : file_of(s) == FILE_H ? ",\n" : ", ");
+    }
+    std::printf("  };\n");
+  }
+  std::printf("}\n");
+}
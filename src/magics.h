@@ -0,0 +1,27 @@
+#pragma once
+
+#include "types.h"
+
+//generated by magicgen (seed 7855), do not edit by hand
+namespace Leaf {
+  constexpr Bitboard BishopMagics[SQUARE_NB] = {
+    0x1240818911020080ULL, 0x40c8038102020408ULL, 0x000408421040c088ULL, 0x0044142080400000ULL, 0x011404a003005080ULL, 0x20110420a4200880ULL, 0x00010090100ac400ULL, 0xc202820241044044ULL,
+    0x0002200610120080ULL, 0xa8102004150200b0ULL, 0x0040905108450000ULL, 0x1200841400805205ULL, 0x0081011040004020ULL, 0x2000920350190080ULL, 0x2000420882084209ULL, 0x00c0010082412000ULL,
+    0x0020004004418600ULL, 0x002004888b340582ULL, 0x0c40419404002044ULL, 0x000a148840810001ULL, 0x40020004010c0020ULL, 0x28c1010600808402ULL, 0x0002000855142000ULL, 0x0601050384148200ULL,
+    0x4021051628100402ULL, 0xe041050008080820ULL, 0x8008040008124210ULL, 0x0412086004040080ULL, 0x4204044004010040ULL, 0x0141250202008080ULL, 0x007808842a0a0540ULL, 0x00010d0002048482ULL,
+    0x0090141000200200ULL, 0x001a100410704109ULL, 0x1204040640a40100ULL, 0x8008600800418820ULL, 0x0040018120020020ULL, 0x0020080a40808048ULL, 0x0101030400620220ULL, 0x9200908202108218ULL,
+    0x48d4041208004010ULL, 0x20050311100c616cULL, 0x0009004430001200ULL, 0x8845c82011001800ULL, 0x1000080900444400ULL, 0x00100410041011a0ULL, 0x1ca1040402410280ULL, 0x0028480051411180ULL,
+    0x4019083110080000ULL, 0x0082024124100000ULL, 0x0000450088041208ULL, 0x2100036094040000ULL, 0xc741049002020092ULL, 0x0482091608160004ULL, 0x00102003050a0104ULL, 0x2020420c004c9200ULL,
+    0x0010820090090801ULL, 0x0020024120901000ULL, 0x2e004a00240a080cULL, 0x0400800003208802ULL, 0x0000800008210100ULL, 0x100140400c080081ULL, 0x1809611302060400ULL, 0xa804108086008200ULL
+  };
+  constexpr Bitboard RookMagics[SQUARE_NB] = {
+    0x808000400082102aULL, 0x00c0022000100041ULL, 0x0080200010008008ULL, 0x0100141001002049ULL, 0x0200020008042010ULL, 0x0080020004008041ULL, 0x1d00020004008100ULL, 0x0100002200508300ULL,
+    0x8800800040022c90ULL, 0x000080200882c000ULL, 0x0002801008802000ULL, 0x2054800801100080ULL, 0x0010800400800802ULL, 0x0002000200101c08ULL, 0x000a000824090200ULL, 0x8804801100004080ULL,
+    0x188180800020400cULL, 0x000c808040002002ULL, 0x0005010020001048ULL, 0x0204808018001000ULL, 0x0118008018810400ULL, 0x0026008004008042ULL, 0x0001040002015008ULL, 0x100202002c008041ULL,
+    0x1000802080004000ULL, 0x100d400100208100ULL, 0x4060008080211008ULL, 0x8004412200100a00ULL, 0x00d2000600200850ULL, 0x0052008200100548ULL, 0x4000180400019002ULL, 0x0000800080204500ULL,
+    0x0001c00425800082ULL, 0xca24200540401000ULL, 0x4000100080802000ULL, 0x0008010880803000ULL, 0x00402c0080800800ULL, 0x4002000422001088ULL, 0x1001004401000200ULL, 0x00108081020010c4ULL,
+    0x4000400232808000ULL, 0x06c0081000206000ULL, 0x0010006000848010ULL, 0x0130022100090010ULL, 0x4004008018018044ULL, 0x040a004810020004ULL, 0x0010484610140065ULL, 0x10820164108a0001ULL,
+    0x808011c000200040ULL, 0x0405230080400100ULL, 0x0061410920001300ULL, 0x2802100020090100ULL, 0x0284100d01280100ULL, 0xa602000468500200ULL, 0x0008020110080400ULL, 0x40200081085c0600ULL,
+    0x0010610080001041ULL, 0x8000810122004092ULL, 0x000900a0000a4011ULL, 0x9002002040850812ULL, 0x000a001020441802ULL, 0x0001001400080201ULL, 0x4000420890030804ULL, 0xa051130180324406ULL
+  };
+}
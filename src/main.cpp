@@ -1,19 +1,35 @@
 #include "bitboard.h"
 #include "board.h"
 #include "hash.h"
+#include "profile.h"
 #include "types.h"
 #include "uci.h"
 
+#include <cstring>
+
 
 using namespace Leaf;
 std::string move_to_san(Board &b, Move m);
 
-int main() {
-  Bitboards::init();
+int main(int argc, char* argv[]) {
+  bool startupProfile = false;
+  for (int i = 1; i < argc; i++)
+    if (std::strcmp(argv[i], "--startup-profile") == 0)
+      startupProfile = true;
+
+  StartupProfile profile;
+  Bitboards::init(&profile);
   init_hash();
+  profile.mark("zobrist keys");
 
   Board board;
   board.init();
+  profile.mark("start position");
+
+  if (startupProfile) {
+    profile.print();
+    return 0;
+  }
 
   UCI_LOOP();
 }
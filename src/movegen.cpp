@@ -4,101 +4,36 @@
 #include <utility>
 
 namespace Leaf {
-  Bitboard whitePawnMoves (Board& b, Square s) {
-    Bitboard moves = 0ULL;
-    Square one = s + NORTH;
-
-    if (!b.squareEmpty(one))
-      return moves;
-
-    moves |= one;
-
-    if (rank_of(s) == RANK_2) {
-      one += NORTH;
-      if (b.squareEmpty(one))
-        moves |= one;
-    }
-
-    return moves;
- }
-  Bitboard blackPawnMoves (Board& b, Square s) {
-    Bitboard moves = 0ULL;
-    Square one = s + SOUTH;
-
-    if (!b.squareEmpty(one))
-      return moves;
-
-    moves |= one;
-
-    if (rank_of(s) == RANK_7) {
-      one += SOUTH;
-      if (b.squareEmpty(one))
-        moves |= one;
-    }
-
-    return moves;
-  }
-
-  Bitboard whiteep (Board& b, Square s) {
-    if (b.Enpassant == Sq0)
+  template <Color Us>
+  Bitboard castlingMoves (Board& b) {
+    constexpr Color Them = ~Us;
+    constexpr uint8_t OO = Us == WHITE ? WHITE_OO : BLACK_OO;
+    constexpr uint8_t OOO = Us == WHITE ? WHITE_OOO : BLACK_OOO;
+    constexpr Square e = Us == WHITE ? e1 : e8, f = Us == WHITE ? f1 : f8, g = Us == WHITE ? g1 : g8;
+    constexpr Square d = Us == WHITE ? d1 : d8, c = Us == WHITE ? c1 : c8, bsq = Us == WHITE ? b1 : b8;
+
+    if (!((OO | OOO) & b.CastleRights))
       return 0;
 
-    Bitboard attacks = PawnAttacks[WHITE][s];
-    if (attacks & b.Enpassant)
-      return square_bb(b.Enpassant);
-
-    return 0;
-  }
-  Bitboard blackep (Board& b, Square s) {
-    if (b.Enpassant == Sq0)
-      return 0;
-
-    Bitboard attacks = PawnAttacks[BLACK][s];
-    if (attacks & b.Enpassant)
-      return square_bb(b.Enpassant);
-
-    return 0;
-  }
-
-  static constexpr Bitboard kingspathwhite = square_bb(e1) | square_bb(f1) | square_bb(g1);
-  static constexpr Bitboard queenspathwhite = square_bb(e1) | square_bb(d1) | square_bb(c1);
-  static constexpr Bitboard kingspathblack = square_bb(e8) | square_bb(f8) | square_bb(g8);
-  static constexpr Bitboard queenspathblack = square_bb(e8) | square_bb(d8) | square_bb(c8);
-  
-  Bitboard whitecastlingmoves (Board& b) {
-
-    if (!(WHITE_CASTLING & b.CastleRights)) {
-      return 0;
-    }
+    //squares between king and rook must be empty, the king's path safe
+    constexpr Bitboard kingsPath = square_bb(e) | square_bb(f) | square_bb(g);
+    constexpr Bitboard queensPath = square_bb(e) | square_bb(d) | square_bb(c);
+    constexpr Bitboard kingsGap = square_bb(f) | square_bb(g);
+    constexpr Bitboard queensGap = square_bb(d) | square_bb(c) | square_bb(bsq);
 
     Bitboard moves = 0;
 
-    if (b.CastleRights & WHITE_OO)
-      if (b.squareEmpty(f1) && b.squareEmpty(g1) && !b.squareAttacked(BLACK, kingspathwhite ))
-        moves |= g1;
+    if ((b.CastleRights & OO) && !(b.Occupancy[2] & kingsGap) && !b.squareAttacked(Them, kingsPath))
+      moves |= g;
 
-    if (b.CastleRights & WHITE_OOO)
-      if (b.squareEmpty(d1) && b.squareEmpty(c1) && b.squareEmpty(b1) && !b.squareAttacked(BLACK, queenspathwhite ))
-        moves |= c1;
+    if ((b.CastleRights & OOO) && !(b.Occupancy[2] & queensGap) && !b.squareAttacked(Them, queensPath))
+      moves |= c;
 
     return moves;
   }
-  Bitboard blackcastlingmoves (Board& b) {
-    if (!(BLACK_CASTLING & b.CastleRights))
-      return 0;
-
-    Bitboard moves = 0;
 
-    if (b.CastleRights & BLACK_OO)
-      if (b.squareEmpty(f8) && b.squareEmpty(g8) && !b.squareAttacked(WHITE, kingspathblack ))
-        moves |= g8;
-
-    if (b.CastleRights & BLACK_OOO)
-      if (b.squareEmpty(d8) && b.squareEmpty(c8) && b.squareEmpty(b8) && !b.squareAttacked(WHITE, queenspathblack ))
-        moves |= c8;
-
-    return moves;
-  }
+  template Bitboard castlingMoves<WHITE> (Board& b);
+  template Bitboard castlingMoves<BLACK> (Board& b);
 
 
   void PsudoMoves (Board& b, Color c, MoveList& list) {
@@ -157,17 +92,292 @@ namespace Leaf {
 
     }
   }
-  void LegalMoves(Board& b, MoveList &list) {
-    MoveList psudo;
-    PsudoMoves(b, b.turn, psudo);
-     for (int i = 0; i < psudo.count; i++) {
-       Board::State st;
-       b.MakeMove(psudo.data[i], st);
-
-       if (!b.kingInCheck())
-         list.add(psudo.data[i]);
-       b.UnmakeMove(psudo.data[i]);
-     }
+  //state shared by the piece generators of one generate call
+  struct GenInfo {
+    Square ksq;
+    Bitboard target;
+    Bitboard pinned;
+    Bitboard discover;
+  };
+
+  template <GenType Type>
+  inline void addMove (Board& b, MoveList& list, const GenInfo& gi, Move m, PieceType pt) {
+    Square from = m.from_sq(), to = m.to_sq();
+    if ((gi.pinned & from) && !(LineBB[gi.ksq][from] & to))
+      return;
+    if (Type == QUIET_CHECKS && !(b.ci.checkSquares[pt] & to) && !((gi.discover & from) && b.givesCheck(m)))
+      return;
+    list.add(m);
+  }
+
+  template <GenType Type>
+  inline void addPromotions (MoveList& list, const GenInfo& gi, Square from, Square to) {
+    if ((gi.pinned & from) && !(LineBB[gi.ksq][from] & to))
+      return;
+    list.add(Move::make<PROMOTION>(from, to, KNIGHT));
+    list.add(Move::make<PROMOTION>(from, to, BISHOP));
+    list.add(Move::make<PROMOTION>(from, to, ROOK));
+    list.add(Move::make<PROMOTION>(from, to, QUEEN));
+  }
+
+  //all pawns at once: each destination set is built with one shift and
+  //the origin is recovered by stepping back along the shift
+  template <Color Us, GenType Type>
+  void pawnMoves (Board& b, MoveList& list, const GenInfo& gi) {
+    constexpr Color Them = ~Us;
+    constexpr Direction Up = pawn_push(Us);
+    constexpr Direction UpRight = Us == WHITE ? NORTH_EAST : SOUTH_WEST;
+    constexpr Direction UpLeft = Us == WHITE ? NORTH_WEST : SOUTH_EAST;
+    constexpr Bitboard TRank7BB = Us == WHITE ? Rank7BB : Rank2BB;
+    constexpr Bitboard TRank3BB = Us == WHITE ? Rank3BB : Rank6BB;
+
+    Bitboard pawns = b.piecebb[make_piece(Us, PAWN)];
+    Bitboard promoting = pawns & TRank7BB;
+    Bitboard rest = pawns & ~TRank7BB;
+    Bitboard empty = ~b.Occupancy[2];
+    Bitboard enemies = b.Occupancy[Them] & gi.target;
+
+    if (Type != CAPTURES) {
+      Bitboard single = shift<Up>(rest) & empty;
+      Bitboard twice = shift<Up>(single & TRank3BB) & empty & gi.target;
+      single &= gi.target;
+
+      while (single) {
+        Square to = pop_lsb(single);
+        addMove<Type>(b, list, gi, Move::make<NORMAL>(to - Up, to), PAWN);
+      }
+      while (twice) {
+        Square to = pop_lsb(twice);
+        addMove<Type>(b, list, gi, Move::make<NORMAL>(to - Up - Up, to), PAWN);
+      }
+    }
+
+    if (Type == QUIETS || Type == QUIET_CHECKS)
+      return;
+
+    if (promoting) {
+      Bitboard right = shift<UpRight>(promoting) & enemies;
+      Bitboard left = shift<UpLeft>(promoting) & enemies;
+      Bitboard push = shift<Up>(promoting) & empty & gi.target;
+
+      while (right) {
+        Square to = pop_lsb(right);
+        addPromotions<Type>(list, gi, to - UpRight, to);
+      }
+      while (left) {
+        Square to = pop_lsb(left);
+        addPromotions<Type>(list, gi, to - UpLeft, to);
+      }
+      while (push) {
+        Square to = pop_lsb(push);
+        addPromotions<Type>(list, gi, to - Up, to);
+      }
+    }
+
+    Bitboard right = shift<UpRight>(rest) & enemies;
+    Bitboard left = shift<UpLeft>(rest) & enemies;
+
+    while (right) {
+      Square to = pop_lsb(right);
+      addMove<Type>(b, list, gi, Move::make<NORMAL>(to - UpRight, to), PAWN);
+    }
+    while (left) {
+      Square to = pop_lsb(left);
+      addMove<Type>(b, list, gi, Move::make<NORMAL>(to - UpLeft, to), PAWN);
+    }
+
+    //en passant can uncover the king along the rank, test it in full
+    if (b.Enpassant != Sq0) {
+      Bitboard takers = rest & pawn_attacks_bb(Them, b.Enpassant);
+      while (takers) {
+        Move m = Move::make<EN_PASSANT>(pop_lsb(takers), b.Enpassant);
+        if (b.isLegal(m))
+          list.add(m);
+      }
+    }
+  }
+
+  template <Color Us, PieceType pt, GenType Type>
+  void pieceMoves (Board& b, MoveList& list, const GenInfo& gi) {
+    Bitboard pieces = b.piecebb[make_piece(Us, pt)];
+    //a pinned knight can never move
+    if (pt == KNIGHT)
+      pieces &= ~gi.pinned;
+
+    while (pieces) {
+      Square from = pop_lsb(pieces);
+      Bitboard attacks = pieceAttacks<Us, pt>(b, from) & gi.target;
+      while (attacks)
+        addMove<Type>(b, list, gi, Move::make<NORMAL>(from, pop_lsb(attacks)), pt);
+    }
+  }
+
+  template <Color Us, GenType Type>
+  void kingMoves (Board& b, MoveList& list, const GenInfo& gi) {
+    constexpr Color Them = ~Us;
+    Square ksq = gi.ksq;
+    Bitboard occupied = b.Occupancy[2] ^ ksq;
+    Bitboard kind = Type == CAPTURES ? b.Occupancy[Them]
+                  : Type == QUIETS || Type == QUIET_CHECKS ? ~b.Occupancy[2] : ~b.Occupancy[Us];
+
+    Bitboard attacks = PsudoAttacks[KING][ksq] & kind;
+    while (attacks) {
+      Square to = pop_lsb(attacks);
+      if (b.attackedBy(Them, to, occupied))
+        continue;
+      Move m = Move::make<NORMAL>(ksq, to);
+      if (Type == QUIET_CHECKS && !b.givesCheck(m))
+        continue;
+      list.add(m);
+    }
+
+    if (Type == CAPTURES || b.ci.checkers)
+      return;
+
+    Bitboard castles = castlingMoves<Us>(b);
+    while (castles) {
+      Move m = Move::make<CASTLING>(ksq, pop_lsb(castles));
+      if (Type == QUIET_CHECKS && !b.givesCheck(m))
+        continue;
+      list.add(m);
+    }
+  }
+
+  //emits only legal moves of the requested kind. checkers and pins come
+  //from the board's cached check info: in double check only the king
+  //moves, in single check the other pieces must capture or block, pinned
+  //pieces stay on their pin ray
+  template <Color Us, GenType Type>
+  void generate (Board& b, MoveList& list) {
+    assert(Type != EVASIONS || b.inCheck());
+
+    constexpr Color Them = ~Us;
+    Bitboard checkers = b.ci.checkers;
+
+    GenInfo gi;
+    gi.ksq = b.getKingSq(Us);
+    gi.pinned = b.ci.blockersForKing[Us] & b.Occupancy[Us];
+    //pieces that uncover a check by moving off the line to the enemy king
+    gi.discover = Type == QUIET_CHECKS ? b.ci.blockersForKing[Them] & b.Occupancy[Us] : 0;
+
+    if (!more_than_one(checkers)) {
+      gi.target = Type == CAPTURES ? b.Occupancy[Them]
+                : Type == QUIETS || Type == QUIET_CHECKS ? ~b.Occupancy[2] : ~b.Occupancy[Us];
+      if (checkers)
+        gi.target &= BetweenBB[gi.ksq][lsb(checkers)] | checkers;
+
+      //pawn captures and promotions sort themselves out by kind, the
+      //target only carries the check restriction for them
+      GenInfo pawns = gi;
+      pawns.target = checkers ? BetweenBB[gi.ksq][lsb(checkers)] | checkers : ~0ULL;
+      pawnMoves<Us, Type>(b, list, pawns);
+      pieceMoves<Us, KNIGHT, Type>(b, list, gi);
+      pieceMoves<Us, BISHOP, Type>(b, list, gi);
+      pieceMoves<Us, ROOK, Type>(b, list, gi);
+      pieceMoves<Us, QUEEN, Type>(b, list, gi);
+    }
+
+    kingMoves<Us, Type>(b, list, gi);
+  }
+
+  template <GenType Type>
+  void generate (Board& b, MoveList& list) {
+    if (b.turn == WHITE)
+      generate<WHITE, Type>(b, list);
+    else
+      generate<BLACK, Type>(b, list);
+  }
+
+  template void generate<CAPTURES> (Board& b, MoveList& list);
+  template void generate<QUIETS> (Board& b, MoveList& list);
+  template void generate<QUIET_CHECKS> (Board& b, MoveList& list);
+  template void generate<EVASIONS> (Board& b, MoveList& list);
+  template void generate<LEGAL> (Board& b, MoveList& list);
+
+  //same rules as generate<LEGAL> but only popcounts the target sets.
+  //unpinned pawns and pieces are counted a whole set at a time, only
+  //pinned ones, king steps and en passant need a look per move
+  template <Color Us>
+  int countLegal (Board& b) {
+    constexpr Color Them = ~Us;
+    constexpr Direction Up = pawn_push(Us);
+    constexpr Direction UpRight = Us == WHITE ? NORTH_EAST : SOUTH_WEST;
+    constexpr Direction UpLeft = Us == WHITE ? NORTH_WEST : SOUTH_EAST;
+    constexpr Bitboard TRank8BB = Us == WHITE ? Rank8BB : Rank1BB;
+    constexpr Bitboard TRank3BB = Us == WHITE ? Rank3BB : Rank6BB;
+
+    Square ksq = b.getKingSq(Us);
+    Bitboard own = b.Occupancy[Us];
+    Bitboard checkers = b.ci.checkers;
+    int count = 0;
+
+    Bitboard occupied = b.Occupancy[2] ^ ksq;
+    Bitboard steps = PsudoAttacks[KING][ksq] & ~own;
+    while (steps)
+      count += !b.attackedBy(Them, pop_lsb(steps), occupied);
+
+    if (more_than_one(checkers))
+      return count;
+    if (!checkers)
+      count += popcount(castlingMoves<Us>(b));
+
+    Bitboard target = checkers ? BetweenBB[ksq][lsb(checkers)] | checkers : ~own;
+    Bitboard pinned = b.ci.blockersForKing[Us] & own;
+    Bitboard empty = ~b.Occupancy[2];
+    Bitboard enemies = b.Occupancy[Them] & target;
+
+    //promotions count four times
+    auto pawnTargets = [&] (Bitboard to) {
+      return popcount(to & ~TRank8BB) + 4 * popcount(to & TRank8BB);
+    };
+
+    Bitboard pawns = b.piecebb[make_piece(Us, PAWN)];
+    Bitboard unpinned = pawns & ~pinned;
+    Bitboard single = shift<Up>(unpinned) & empty;
+    count += pawnTargets(single & target);
+    count += popcount(shift<Up>(single & TRank3BB) & empty & target);
+    count += pawnTargets(shift<UpRight>(unpinned) & enemies);
+    count += pawnTargets(shift<UpLeft>(unpinned) & enemies);
+
+    Bitboard stuck = pawns & pinned;
+    while (stuck) {
+      Square from = pop_lsb(stuck);
+      Bitboard to = (pawnPushes<Us>(b, square_bb(from)) & target) | (PawnAttacks[Us][from] & enemies);
+      count += pawnTargets(to & LineBB[ksq][from]);
+    }
+
+    if (b.Enpassant != Sq0) {
+      Bitboard takers = pawns & pawn_attacks_bb(Them, b.Enpassant);
+      while (takers)
+        count += b.isLegal(Move::make<EN_PASSANT>(pop_lsb(takers), b.Enpassant));
+    }
+
+    Bitboard knights = b.piecebb[make_piece(Us, KNIGHT)] & ~pinned;
+    while (knights)
+      count += popcount(PsudoAttacks[KNIGHT][pop_lsb(knights)] & target);
+
+    Bitboard bishops = b.piecebb[make_piece(Us, BISHOP)] | b.piecebb[make_piece(Us, QUEEN)];
+    Bitboard rooks = b.piecebb[make_piece(Us, ROOK)] | b.piecebb[make_piece(Us, QUEEN)];
+    while (bishops) {
+      Square from = pop_lsb(bishops);
+      Bitboard to = attacks_bb<BISHOP>(from, b.Occupancy[2]) & target;
+      count += popcount(pinned & from ? to & LineBB[ksq][from] : to);
+    }
+    while (rooks) {
+      Square from = pop_lsb(rooks);
+      Bitboard to = attacks_bb<ROOK>(from, b.Occupancy[2]) & target;
+      count += popcount(pinned & from ? to & LineBB[ksq][from] : to);
+    }
+
+    return count;
+  }
+
+  int countLegal (Board& b) {
+    return b.turn == WHITE ? countLegal<WHITE>(b) : countLegal<BLACK>(b);
+  }
+
+  void LegalMoves (Board& b, MoveList &list) {
+    generate<LEGAL>(b, list);
   }
   
 }
@@ -8,8 +8,19 @@
 
 namespace Leaf {
 
+  //a move with room for its ordering score, so a move picker can score a
+  //list once and select from it in place
+  struct ExtMove : Move {
+    int value;
+
+    ExtMove& operator= (Move m) {
+      data = m.raw();
+      return *this;
+    }
+  };
+
   struct MoveList {
-    Move data[256];
+    ExtMove data[256];
     int count = 0;
 
     inline void add (const Move& m) {
@@ -19,27 +30,27 @@ namespace Leaf {
   };
 
 
-  Bitboard whitePawnMoves (Board& b, Square s);
-  Bitboard blackPawnMoves (Board& b, Square s);
-  Bitboard whiteep (Board& b, Square s);
-  Bitboard blackep (Board& b, Square s);
-  Bitboard whitecastlingmoves (Board& b);
-  Bitboard blackcastlingmoves (Board& b);
+  //single and double pushes of a whole set of pawns
+  template <Color Us>
+    inline Bitboard pawnPushes (Board& b, Bitboard pawns) {
+      constexpr Direction Up = pawn_push(Us);
+      constexpr Bitboard TRank3BB = Us == WHITE ? Rank3BB : Rank6BB;
+      Bitboard empty = ~b.Occupancy[2];
+      Bitboard single = shift<Up>(pawns) & empty;
+      return single | (shift<Up>(single & TRank3BB) & empty);
+    }
+
+  template <Color Us>
+    Bitboard castlingMoves (Board& b);
 
-  template <PieceType pt>
-    Bitboard pieceAttacks (Board& b, Square s) {
+  template <Color Us, PieceType pt>
+    inline Bitboard pieceAttacks (Board& b, Square s) {
       if constexpr (pt == PAWN) {
-        if (color_of(b.data[s]) == WHITE)
-          return whitePawnMoves(b, s) | (PawnAttacks[WHITE][s] & b.Occupancy[BLACK]) | whiteep(b, s);
-        else
-          return blackPawnMoves(b, s) | (PawnAttacks[BLACK][s] & b.Occupancy[WHITE]) | blackep(b, s);
-      }
-      else if constexpr (pt == KING) {
-        if (color_of(b.data[s]) == WHITE)
-          return PsudoAttacks[KING][s] | whitecastlingmoves(b);
-        else
-          return PsudoAttacks[KING][s] | blackcastlingmoves(b);
+        Bitboard ep = b.Enpassant != Sq0 ? square_bb(b.Enpassant) : 0;
+        return pawnPushes<Us>(b, square_bb(s)) | (PawnAttacks[Us][s] & (b.Occupancy[~Us] | ep));
       }
+      else if constexpr (pt == KING)
+        return PsudoAttacks[KING][s] | castlingMoves<Us>(b);
       else if constexpr (pt == KNIGHT)
         return PsudoAttacks[KNIGHT][s];
       else if constexpr (pt == BISHOP)
@@ -52,25 +63,47 @@ namespace Leaf {
         return 0;
     }
 
-  inline Bitboard pieceAttacks(Board& b, PieceType pt, Square s) {
-    Bitboard attacks;
-
-    switch (pt) {
-      case PAWN : attacks = pieceAttacks<PAWN>(b, s); break;
-      case KNIGHT : attacks = pieceAttacks<KNIGHT>(b, s); break;
-      case BISHOP : attacks = pieceAttacks<BISHOP>(b, s); break;
-      case ROOK : attacks = pieceAttacks<ROOK>(b, s); break;
-      case QUEEN : attacks = pieceAttacks<QUEEN>(b, s); break;
-      case KING : attacks = pieceAttacks<KING>(b, s); break;
-      default : return 0;
+  template <Color Us>
+    inline Bitboard pieceAttacks (Board& b, PieceType pt, Square s) {
+      Bitboard attacks;
+
+      switch (pt) {
+        case PAWN : attacks = pieceAttacks<Us, PAWN>(b, s); break;
+        case KNIGHT : attacks = pieceAttacks<Us, KNIGHT>(b, s); break;
+        case BISHOP : attacks = pieceAttacks<Us, BISHOP>(b, s); break;
+        case ROOK : attacks = pieceAttacks<Us, ROOK>(b, s); break;
+        case QUEEN : attacks = pieceAttacks<Us, QUEEN>(b, s); break;
+        case KING : attacks = pieceAttacks<Us, KING>(b, s); break;
+        default : return 0;
+      }
+
+      return attacks & ~b.Occupancy[Us];
     }
 
-    Bitboard freindly = (b.turn == WHITE) ? b.Occupancy[WHITE] : b.Occupancy[BLACK];
-    return attacks & ~freindly;
+  //moves of the piece on s for the side to move
+  inline Bitboard pieceAttacks (Board& b, PieceType pt, Square s) {
+    return b.turn == WHITE ? pieceAttacks<WHITE>(b, pt, s) : pieceAttacks<BLACK>(b, pt, s);
   }
 
+  //legal move subsets. CAPTURES holds captures, en passant and every
+  //promotion, QUIETS everything else, so the two together give LEGAL.
+  //QUIET_CHECKS is the part of QUIETS that checks, EVASIONS is only valid
+  //in check and returns all legal moves there
+  enum GenType {
+    CAPTURES,
+    QUIETS,
+    QUIET_CHECKS,
+    EVASIONS,
+    LEGAL
+  };
+
+  template <GenType Type>
+  void generate (Board& b, MoveList& list);
+
   void PsudoMoves (Board& b, Color c, MoveList& list);
   void LegalMoves (Board& b, MoveList& list);
+  //number of legal moves without building the list
+  int countLegal (Board& b);
   int moveScore (Board& b, Move& m);
 
 }
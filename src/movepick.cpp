@@ -0,0 +1,194 @@
+#include "movepick.h"
+#include "types.h"
+#include <utility>
+
+namespace Leaf {
+
+  MovePicker::MovePicker (Board& b, Move tt, Move k1, Move k2, const History& h)
+    : b(b), history(&h), stage(TT_MOVE), ttMove(tt) {
+    killers[0] = k1;
+    killers[1] = k2 != k1 ? k2 : Move::none();
+  }
+
+  MovePicker::MovePicker (Board& b)
+    : b(b), history(nullptr), stage(b.inCheck() ? GEN_EVASIONS : QS_GEN_CAPTURES), ttMove(Move::none()) {
+    killers[0] = killers[1] = Move::none();
+  }
+
+  //captures, en passant and promotions
+  static inline bool noisy (Board& b, Move m) {
+    return b.isCapture(m) || m.type_of() == EN_PASSANT || m.type_of() == PROMOTION;
+  }
+
+  //most valuable victim first, least valuable attacker among equals
+  constexpr int MvvLva[PIECE_TYPE_NB][PIECE_TYPE_NB] = {
+    //attacker: -, P, N, B, R, Q, K
+    {0,  0,  0,  0,  0,  0,  0, 0},
+    {0, 15, 14, 13, 12, 11, 10, 0},
+    {0, 25, 24, 23, 22, 21, 20, 0},
+    {0, 35, 34, 33, 32, 31, 30, 0},
+    {0, 45, 44, 43, 42, 41, 40, 0},
+    {0, 55, 54, 53, 52, 51, 50, 0},
+  };
+
+  //killers are ranked above any history score when in check
+  constexpr int KillerBonus = 1 << 20;
+  constexpr int NoisyBonus = 1 << 24;
+
+  //promotions score like a pawn taking the piece they turn into
+  static inline int noisyScore (Board& b, Move m) {
+    int score = MvvLva[b.capturedpt(m)][type_of(b.data[m.from_sq()])];
+    if (m.type_of() == PROMOTION)
+      score += MvvLva[m.promotion_type()][PAWN];
+    return score;
+  }
+
+  //a capture is good when the victim is worth at least the attacker less a
+  //pawn, underpromotions are tried with the losing captures
+  static inline bool goodNoisy (Board& b, Move m) {
+    if (m.type_of() == PROMOTION)
+      return m.promotion_type() == QUEEN;
+    if (m.type_of() == EN_PASSANT)
+      return true;
+    return PieceValue[b.data[m.to_sq()]] + PawnValue >= PieceValue[b.data[m.from_sq()]];
+  }
+
+  //moves the current stage must not hand out again
+  bool MovePicker::special (Move m) {
+    return m == ttMove || m == killers[0] || m == killers[1];
+  }
+
+  void MovePicker::scoreNoisy (int begin, int end) {
+    for (int i = begin; i < end; i++)
+      moves.data[i].value = noisyScore(b, moves.data[i]);
+  }
+
+  void MovePicker::scoreQuiets (int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      ExtMove& m = moves.data[i];
+      m.value = history ? history->Table[b.turn][m.from_sq()][m.to_sq()] : 0;
+    }
+  }
+
+  //captures first by mvv-lva, then killers, then the quiets by history
+  void MovePicker::scoreEvasions () {
+    scoreQuiets(0, moves.count);
+    for (int i = 0; i < moves.count; i++) {
+      ExtMove& m = moves.data[i];
+      if (noisy(b, m))
+        m.value = NoisyBonus + noisyScore(b, m);
+      else if (m == killers[0] || m == killers[1])
+        m.value += KillerBonus;
+    }
+  }
+
+  //selection step, only the part of the list that is actually searched
+  //ever gets sorted
+  Move MovePicker::pickBest (int begin, int end) {
+    int best = begin;
+    for (int i = begin + 1; i < end; i++)
+      if (moves.data[i].value > moves.data[best].value)
+        best = i;
+    std::swap(moves.data[begin], moves.data[best]);
+    return moves.data[begin];
+  }
+
+  Move MovePicker::next () {
+    switch (stage) {
+      case TT_MOVE :
+        stage = b.inCheck() ? GEN_EVASIONS : GEN_CAPTURES;
+        if (b.isPseudoLegal(ttMove) && b.isLegal(ttMove))
+          return ttMove;
+        ttMove = Move::none();
+        return next();
+
+      case GEN_CAPTURES :
+        generate<CAPTURES>(b, moves);
+        noisyEnd = moves.count;
+        scoreNoisy(0, noisyEnd);
+        cur = 0;
+        stage = GOOD_CAPTURES;
+        [[fallthrough]];
+
+      case GOOD_CAPTURES :
+        while (cur < noisyEnd) {
+          Move m = pickBest(cur++, noisyEnd);
+          if (m == ttMove)
+            continue;
+          if (!goodNoisy(b, m)) {
+            bad[badCount++] = m;
+            continue;
+          }
+          return m;
+        }
+        stage = KILLERS;
+        [[fallthrough]];
+
+      case KILLERS :
+        while (killerIdx < 2) {
+          Move m = killers[killerIdx++];
+          if (m != ttMove && b.isPseudoLegal(m) && !noisy(b, m) && b.isLegal(m))
+            return m;
+        }
+        stage = GEN_QUIETS;
+        [[fallthrough]];
+
+      case GEN_QUIETS :
+        generate<QUIETS>(b, moves);
+        scoreQuiets(noisyEnd, moves.count);
+        cur = noisyEnd;
+        stage = QUIET_MOVES;
+        [[fallthrough]];
+
+      case QUIET_MOVES :
+        while (cur < moves.count) {
+          Move m = pickBest(cur++, moves.count);
+          if (!special(m))
+            return m;
+        }
+        stage = BAD_CAPTURES;
+        [[fallthrough]];
+
+      case BAD_CAPTURES :
+        if (badCur < badCount)
+          return bad[badCur++];
+        stage = DONE;
+        return Move::none();
+
+      case GEN_EVASIONS :
+        generate<EVASIONS>(b, moves);
+        scoreEvasions();
+        cur = 0;
+        stage = EVASION_MOVES;
+        [[fallthrough]];
+
+      case EVASION_MOVES :
+        while (cur < moves.count) {
+          Move m = pickBest(cur++, moves.count);
+          if (m != ttMove)
+            return m;
+        }
+        stage = DONE;
+        return Move::none();
+
+      case QS_GEN_CAPTURES :
+        generate<CAPTURES>(b, moves);
+        noisyEnd = moves.count;
+        scoreNoisy(0, noisyEnd);
+        cur = 0;
+        stage = QS_CAPTURES;
+        [[fallthrough]];
+
+      case QS_CAPTURES :
+        if (cur < noisyEnd)
+          return pickBest(cur++, noisyEnd);
+        stage = DONE;
+        [[fallthrough]];
+
+      case DONE :
+        return Move::none();
+    }
+    return Move::none();
+  }
+
+}
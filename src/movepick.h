@@ -0,0 +1,66 @@
+#pragma once
+
+#include "types.h"
+#include "board.h"
+#include "movegen.h"
+
+namespace Leaf {
+
+  //quiet move scores by side, from and to square, bumped on every quiet
+  //beta cutoff so moves that refuted siblings are tried early
+  struct History {
+    int Table[COLOR_NB][SQUARE_NB][SQUARE_NB];
+
+    void clear () {
+      for (int c = 0; c < COLOR_NB; c++)
+        for (int f = 0; f < SQUARE_NB; f++)
+          for (int t = 0; t < SQUARE_NB; t++)
+            Table[c][f][t] = 0;
+    }
+    inline void update (Color c, Move m, int depth) {
+      Table[c][m.from_sq()][m.to_sq()] += depth * depth;
+    }
+  };
+
+  //hands out the moves of a node one at a time, best guess first:
+  //tt move, good captures, killers, quiets by history, bad captures.
+  //a stage is only generated and scored once the ones before it are used
+  //up, so a cutoff on an early move skips the rest. in check all evasions
+  //come out in one stage after the tt move
+  class MovePicker {
+    public:
+    MovePicker (Board& b, Move tt, Move k1, Move k2, const History& h);
+    //quiescence: captures and promotions, or the evasions when in check
+    MovePicker (Board& b);
+
+    Move next ();
+
+    private:
+    enum Stage {
+      TT_MOVE, GEN_CAPTURES, GOOD_CAPTURES, KILLERS, GEN_QUIETS, QUIET_MOVES, BAD_CAPTURES,
+      GEN_EVASIONS, EVASION_MOVES,
+      QS_GEN_CAPTURES, QS_CAPTURES, DONE
+    };
+
+    void scoreNoisy (int begin, int end);
+    void scoreQuiets (int begin, int end);
+    void scoreEvasions ();
+    Move pickBest (int begin, int end);
+    bool special (Move m);
+
+    Board& b;
+    const History* history;
+    Stage stage;
+    Move ttMove;
+    Move killers[2];
+    int killerIdx = 0;
+
+    //noisy moves sit in [0, noisyEnd), quiets are appended after them,
+    //captures that lose material are parked in bad
+    MoveList moves;
+    int noisyEnd = 0, cur = 0;
+    Move bad[256];
+    int badCount = 0, badCur = 0;
+  };
+
+}
@@ -0,0 +1,187 @@
+#include "perft.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace Leaf {
+
+  namespace {
+
+    //a subtree: the root move and, when the tree is split two plies
+    //deep, the reply to it
+    struct PerftTask {
+      int root;
+      Move reply;
+    };
+
+    //owner takes from the front, thieves from the back
+    struct TaskQueue {
+      std::mutex lock;
+      std::deque<PerftTask> tasks;
+
+      bool pop (PerftTask& t) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (tasks.empty())
+          return false;
+        t = tasks.front();
+        tasks.pop_front();
+        return true;
+      }
+      bool steal (PerftTask& t) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (tasks.empty())
+          return false;
+        t = tasks.back();
+        tasks.pop_back();
+        return true;
+      }
+    };
+
+  }
+
+  PerftCache::PerftCache (size_t mb) {
+    //largest power of two number of entries that fits
+    size_t entries = 1;
+    while (entries * 2 * sizeof(Entry) <= std::max<size_t>(mb, 1) << 20)
+      entries *= 2;
+    table.reset(new Entry[entries]);
+    for (size_t i = 0; i < entries; i++) {
+      table[i].check.store(0, std::memory_order_relaxed);
+      table[i].nodes.store(0, std::memory_order_relaxed);
+    }
+    mask = entries - 1;
+  }
+
+  uint64_t perft_cached (Board& b, int depth, PerftCache& cache, PerftStats& stats) {
+    if (depth <= 0)
+      return 1;
+    if (depth == 1)
+      return countLegal(b);
+
+    uint64_t nodes;
+    stats.probes++;
+    if (cache.probe(b.key, depth, nodes)) {
+      stats.hits++;
+      return nodes;
+    }
+
+    nodes = 0;
+    MoveList list;
+    LegalMoves(b, list);
+
+    Board::State st;
+    for (int i = 0; i < list.count; i++) {
+      b.MakeMove(list.data[i], st);
+      nodes += perft_cached(b, depth - 1, cache, stats);
+      b.UnmakeMove(list.data[i]);
+    }
+
+    cache.store(b.key, depth, nodes);
+    return nodes;
+  }
+
+  PerftResult perft_parallel (Board& b, int depth, int threads, PerftCache* cache) {
+    auto start = std::chrono::steady_clock::now();
+
+    if (threads <= 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+
+    PerftResult result;
+    //only the root, there is nothing to divide
+    if (depth <= 0) {
+      result.nodes = 1;
+      return result;
+    }
+
+    MoveList roots;
+    LegalMoves(b, roots);
+    for (int i = 0; i < roots.count; i++)
+      result.divide.emplace_back(roots.data[i], depth > 1 ? 0 : 1);
+
+    //two plies of split give a few hundred to a thousand subtrees, enough
+    //to keep many cores busy when one root move hides a big tree
+    int split = depth >= 3 ? 2 : 1;
+    std::vector<TaskQueue> queues(threads);
+    int next = 0;
+    if (depth > 1) {
+      Board::State st;
+      for (int i = 0; i < roots.count; i++) {
+        if (split == 1) {
+          queues[next++ % threads].tasks.push_back({i, Move::none()});
+          continue;
+        }
+        b.MakeMove(roots.data[i], st);
+        MoveList replies;
+        LegalMoves(b, replies);
+        b.UnmakeMove(roots.data[i]);
+        for (int j = 0; j < replies.count; j++)
+          queues[next++ % threads].tasks.push_back({i, replies.data[j]});
+      }
+    }
+
+    std::vector<std::atomic<uint64_t>> counts(roots.count);
+    for (auto& c : counts)
+      c.store(0);
+
+    std::mutex statsLock;
+
+    auto worker = [&] (int id) {
+      Board local = b.fork();
+      PerftStats stats;
+      auto count = [&] (int d) {
+        return cache ? perft_cached(local, d, *cache, stats) : perft(local, d);
+      };
+
+      PerftTask t;
+      Board::State st[2];
+      for (;;) {
+        bool found = queues[id].pop(t);
+        for (int k = 1; !found && k < threads; k++)
+          found = queues[(id + k) % threads].steal(t);
+        if (!found)
+          break;
+
+        Move root = roots.data[t.root];
+        local.MakeMove(root, st[0]);
+        uint64_t nodes;
+        if (t.reply) {
+          local.MakeMove(t.reply, st[1]);
+          nodes = count(depth - 2);
+          local.UnmakeMove(t.reply);
+        }
+        else
+          nodes = count(depth - 1);
+        local.UnmakeMove(root);
+
+        counts[t.root].fetch_add(nodes, std::memory_order_relaxed);
+      }
+
+      std::lock_guard<std::mutex> guard(statsLock);
+      result.cache.probes += stats.probes;
+      result.cache.hits += stats.hits;
+    };
+
+    if (depth > 1) {
+      std::vector<std::thread> pool;
+      for (int i = 1; i < threads; i++)
+        pool.emplace_back(worker, i);
+      worker(0);
+      for (std::thread& th : pool)
+        th.join();
+
+      for (int i = 0; i < roots.count; i++)
+        result.divide[i].second = counts[i].load();
+    }
+
+    for (auto& d : result.divide)
+      result.nodes += d.second;
+
+    result.seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+        std::chrono::steady_clock::now() - start).count();
+    return result;
+  }
+
+}
@@ -3,6 +3,10 @@
 #include "bitboard.h"
 #include "movegen.h"
 
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 #include <cstdint>
 #include <iostream>
@@ -17,11 +21,10 @@ namespace Leaf {
   }
 
   inline  uint64_t perft(Board& b, int depth) {
-    if (depth == 1) {
-      MoveList list;
-      LegalMoves(b, list);
-      return list.count;
-    }
+    if (depth <= 0)
+      return 1;
+    if (depth == 1)
+      return countLegal(b);
 
     uint64_t nodes = 0;
     MoveList list;
@@ -36,6 +39,27 @@ namespace Leaf {
     return nodes;
   }
 
+  //same count but every child is searched on a copy of the board,
+  //the parent is never unmade
+  inline uint64_t perft_copymake(Board& b, int depth) {
+    if (depth <= 0)
+      return 1;
+    if (depth == 1)
+      return countLegal(b);
+
+    MoveList list;
+    LegalMoves(b, list);
+
+    uint64_t nodes = 0;
+    Board::State st;
+    for (int i = 0; i < list.count; i++) {
+      Board child = b.child();
+      child.MakeMove(list.data[i], st);
+      nodes += perft_copymake(child, depth - 1);
+    }
+    return nodes;
+  }
+
   inline void perft_benchmark (Board& b, int depth) {
     auto start = std::chrono::steady_clock::now();
     std::cout << "Recieved board" << std::endl;
@@ -52,30 +76,70 @@ namespace Leaf {
     std::cout << "Nps " << nps << std::endl;
   }
 
-  /*
-  void perft_divide(Board& b, int depth) {
-    assert(depth >= 1);
-
-    uint64_t total = 0;
-
-    std::vector<Move> moves = LegalMoves(b, b.turn);
+  //subtree counts keyed by position and remaining depth, shared by all
+  //perft workers without locks. the check word is key ^ depth ^ nodes, so
+  //an entry torn by two racing writers fails the probe instead of
+  //returning a wrong count
+  class PerftCache {
+    struct Entry {
+      std::atomic<uint64_t> check;
+      std::atomic<uint64_t> nodes;
+    };
+
+    std::unique_ptr<Entry[]> table;
+    size_t mask;
+
+    static inline uint64_t tag (Hash key, int depth) {
+      return key ^ (uint64_t(depth) * 0x9E3779B97F4A7C15ULL);
+    }
 
-    for (Move& m : moves) {
-        Board back = b;
-        Board::State st;
+    public:
+    explicit PerftCache (size_t mb);
 
-        back.MakeMove(m, st);
+    inline bool probe (Hash key, int depth, uint64_t& nodes) {
+      Entry& e = table[key & mask];
+      uint64_t n = e.nodes.load(std::memory_order_relaxed);
+      if ((e.check.load(std::memory_order_relaxed) ^ n) != tag(key, depth))
+        return false;
+      nodes = n;
+      return true;
+    }
+    inline void store (Hash key, int depth, uint64_t nodes) {
+      Entry& e = table[key & mask];
+      e.check.store(tag(key, depth) ^ nodes, std::memory_order_relaxed);
+      e.nodes.store(nodes, std::memory_order_relaxed);
+    }
+  };
 
-        uint64_t nodes = perft(back, depth - 1);
+  //probes and hits of the perft cache, kept per worker and summed
+  struct PerftStats {
+    uint64_t probes = 0;
+    uint64_t hits = 0;
+  };
 
-        back.UnmakeMove(m);
+  uint64_t perft_cached (Board& b, int depth, PerftCache& cache, PerftStats& stats);
 
-        std::cout << sqTostr(m.from_sq()) << " " << sqTostr(m.to_sq()) ;
-        std::cout << ": " << nodes << "\n";
+  struct PerftResult {
+    uint64_t nodes = 0;
+    double seconds = 0;
+    //nodes under each root move, in generation order
+    std::vector<std::pair<Move, uint64_t>> divide;
+    PerftStats cache;
 
-        total += nodes;
+    uint64_t nps () const {
+      return seconds > 0 ? uint64_t(nodes / seconds) : 0;
     }
-
-    std::cout << "\nTotal nodes: " << total << "\n";
-  }*/
+    double hitRate () const {
+      return cache.probes ? double(cache.hits) / cache.probes : 0;
+    }
+  };
+
+  //perft on threads workers, each on its own copy of b. the tree is cut
+  //into root move and reply subtrees which idle workers steal from the
+  //others' queues. threads 0 uses every hardware thread. with a cache,
+  //subtrees already counted are looked up instead of generated
+  PerftResult perft_parallel (Board& b, int depth, int threads = 0, PerftCache* cache = nullptr);
+  inline PerftResult perft_divide (Board& b, int depth) {
+    return perft_parallel(b, depth, 1);
+  }
 }
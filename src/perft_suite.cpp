@@ -0,0 +1,325 @@
+#include "bitboard.h"
+#include "board.h"
+#include "hash.h"
+#include "movegen.h"
+#include "perft.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <iterator>
+#include <vector>
+
+using namespace Leaf;
+
+namespace {
+
+  struct SuiteEntry {
+    std::string fen;
+    //expected node count per depth, 0 when the file does not list it
+    std::vector<uint64_t> counts;
+  };
+
+  //one position per line: fen ;D1 20 ;D2 400 ...
+  std::vector<SuiteEntry> readEPD (const std::string& path) {
+    std::vector<SuiteEntry> entries;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#')
+        continue;
+
+      std::istringstream fields(line);
+      SuiteEntry e;
+      std::string field;
+      std::getline(fields, e.fen, ';');
+      while (std::getline(fields, field, ';')) {
+        std::istringstream ss(field);
+        std::string depth;
+        uint64_t nodes;
+        if (!(ss >> depth >> nodes) || depth.size() < 2 || depth[0] != 'D')
+          continue;
+        size_t d = std::stoul(depth.substr(1));
+        if (e.counts.size() <= d)
+          e.counts.resize(d + 1, 0);
+        e.counts[d] = nodes;
+      }
+      entries.push_back(e);
+    }
+    return entries;
+  }
+
+  std::string moveStr (Move m) {
+    std::string s = sqTostr(m.from_sq()) + sqTostr(m.to_sq());
+    if (m.type_of() == PROMOTION)
+      s += " nbrq"[m.promotion_type() - PAWN];
+    return s;
+  }
+
+  //order independent comparison of two move lists
+  bool sameMoves (const MoveList& a, const MoveList& b) {
+    if (a.count != b.count)
+      return false;
+    std::vector<uint16_t> x, y;
+    for (int i = 0; i < a.count; i++) {
+      x.push_back(a.data[i].raw());
+      y.push_back(b.data[i].raw());
+    }
+    std::sort(x.begin(), x.end());
+    std::sort(y.begin(), y.end());
+    return x == y;
+  }
+
+  bool contains (const MoveList& list, Move m) {
+    for (int i = 0; i < list.count; i++)
+      if (list.data[i] == m)
+        return true;
+    return false;
+  }
+
+  bool noisy (Board& b, Move m) {
+    return b.isCapture(m) || m.type_of() == EN_PASSANT || m.type_of() == PROMOTION;
+  }
+
+  //everything a node is checked against: its legal moves and the legal
+  //moves of its parent, which are the usual stale tt and killer moves
+  struct Node {
+    Board& b;
+    const MoveList& legal;
+    const MoveList& parent;
+  };
+
+  //CAPTURES and QUIETS split LEGAL, QUIET_CHECKS is the checking part of
+  //QUIETS and EVASIONS gives LEGAL when in check
+  bool typedGenerators (Node& n) {
+    MoveList captures, quiets, both, checks;
+    generate<CAPTURES>(n.b, captures);
+    generate<QUIETS>(n.b, quiets);
+    generate<CAPTURES>(n.b, both);
+    generate<QUIETS>(n.b, both);
+    generate<QUIET_CHECKS>(n.b, checks);
+    if (!sameMoves(both, n.legal))
+      return false;
+
+    MoveList quietChecks;
+    for (int i = 0; i < captures.count; i++)
+      if (!noisy(n.b, captures.data[i]))
+        return false;
+    for (int i = 0; i < quiets.count; i++) {
+      if (noisy(n.b, quiets.data[i]))
+        return false;
+      if (n.b.givesCheck(quiets.data[i]))
+        quietChecks.add(quiets.data[i]);
+    }
+    if (!sameMoves(checks, quietChecks))
+      return false;
+
+    if (n.b.inCheck()) {
+      MoveList evasions;
+      generate<EVASIONS>(n.b, evasions);
+      return sameMoves(evasions, n.legal);
+    }
+    return true;
+  }
+
+  //isPseudoLegal accepts exactly the generator's pseudo legal moves and
+  //isLegal exactly the legal ones among them, tried on those moves, on
+  //the parent's moves and on no move at all
+  bool moveChecks (Node& n) {
+    MoveList pseudo;
+    PsudoMoves(n.b, n.b.turn, pseudo);
+    if (n.b.isPseudoLegal(Move::none()))
+      return false;
+
+    for (const MoveList* list : {(const MoveList*) &pseudo, &n.parent})
+      for (int i = 0; i < list->count; i++) {
+        Move m = list->data[i];
+        bool p = n.b.isPseudoLegal(m);
+        if (p != contains(pseudo, m))
+          return false;
+        if (p && n.b.isLegal(m) != contains(n.legal, m))
+          return false;
+      }
+    return true;
+  }
+
+  //keyAfter predicts the key MakeMove ends up with, for every legal move
+  bool keyAfter (Node& n) {
+    Board::State st;
+    for (int i = 0; i < n.legal.count; i++) {
+      Move m = n.legal.data[i];
+      Hash predicted = n.b.keyAfter(m);
+      n.b.MakeMove(m, st);
+      bool same = predicted == n.b.key;
+      n.b.UnmakeMove(m);
+      if (!same)
+        return false;
+    }
+    return true;
+  }
+
+  //the bulk counter used at perft leaves agrees with the generator
+  bool countLegal (Node& n) {
+    return Leaf::countLegal(n.b) == n.legal.count;
+  }
+
+  //the set-wise attack map of each side matches a square by square
+  //attackedBy scan, with the scalar fill and with avx2 when there
+  bool attackMaps (Node& n) {
+    bool avx2 = UseAvx2;
+    bool same = true;
+    for (Color c : {WHITE, BLACK}) {
+      Bitboard expected = 0;
+      for (Square s = a1; s < SQUARE_NB; ++s)
+        if (n.b.attackedBy(c, s, n.b.Occupancy[2]))
+          expected |= s;
+      for (bool use : {false, avx2}) {
+        UseAvx2 = use;
+        same &= n.b.attacksBy(c) == expected;
+      }
+    }
+    UseAvx2 = avx2;
+    return same;
+  }
+
+  struct Invariant {
+    const char* name;
+    bool (*holds) (Node& n);
+    uint64_t failed = 0;
+  };
+
+  Invariant invariants[] = {
+    {"typed_generators", typedGenerators},
+    {"pseudo_legal", moveChecks},
+    {"key_after", keyAfter},
+    {"count_legal", countLegal},
+    {"attack_maps", attackMaps},
+  };
+
+  //runs every invariant on every node down to depth, the first failing
+  //fen of each invariant is printed
+  uint64_t checkTree (Board& b, int depth, const MoveList& parent) {
+    MoveList legal;
+    LegalMoves(b, legal);
+    Node n{b, legal, parent};
+    for (Invariant& inv : invariants) {
+      if (inv.holds(n))
+        continue;
+      if (!inv.failed++)
+        std::cout << "  " << inv.name << " fails on " << b.toFEN() << "\n";
+    }
+
+    uint64_t nodes = 1;
+    if (depth == 0)
+      return nodes;
+    Board::State st;
+    for (int i = 0; i < legal.count; i++) {
+      b.MakeMove(legal.data[i], st);
+      nodes += checkTree(b, depth - 1, legal);
+      b.UnmakeMove(legal.data[i]);
+    }
+    return nodes;
+  }
+
+  //--check mode: the move generation invariants over every epd position
+  int runChecks (const std::vector<SuiteEntry>& entries, int depth) {
+    uint64_t nodes = 0;
+    MoveList none;
+    for (const SuiteEntry& e : entries) {
+      Board b;
+      b.loadFEN(e.fen);
+      nodes += checkTree(b, depth, none);
+    }
+
+    uint64_t failed = 0;
+    for (const Invariant& inv : invariants) {
+      std::cout << "check " << inv.name << " nodes " << nodes << (inv.failed ? " FAIL " : " pass ")
+                << inv.failed << "\n";
+      failed += inv.failed;
+    }
+    std::cout << "checks positions=" << entries.size() << " depth=" << depth << " nodes=" << nodes
+              << " invariants=" << std::size(invariants) << " failed=" << failed << std::endl;
+    return failed ? 1 : 0;
+  }
+
+}
+
+//usage: perft_suite [epd] [--depth max] [--threads n] [--hash mb]
+//       perft_suite [epd] --check [depth]
+//every listed depth up to max is checked, the last line sums up the run
+//as key=value pairs for scripts. exits non zero when a count is off.
+//--check walks each position to depth (3) and checks the move generation
+//invariants at every node instead of counting
+int main (int argc, char* argv[]) {
+  Bitboards::init();
+  init_hash();
+
+  std::string path = PERFT_SUITE_EPD;
+  int maxDepth = 6, threads = 0, hashMb = 0, checkDepth = -1;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--check") {
+      checkDepth = 3;
+      if (i + 1 < argc && std::isdigit(argv[i + 1][0]))
+        checkDepth = std::stoi(argv[++i]);
+    }
+    else if (arg == "--depth" && i + 1 < argc)
+      maxDepth = std::stoi(argv[++i]);
+    else if (arg == "--threads" && i + 1 < argc)
+      threads = std::stoi(argv[++i]);
+    else if (arg == "--hash" && i + 1 < argc)
+      hashMb = std::stoi(argv[++i]);
+    else
+      path = arg;
+  }
+
+  std::vector<SuiteEntry> entries = readEPD(path);
+  if (entries.empty()) {
+    std::cerr << "no positions read from " << path << std::endl;
+    return 2;
+  }
+  if (checkDepth >= 0)
+    return runChecks(entries, checkDepth);
+
+  std::unique_ptr<PerftCache> cache;
+  if (hashMb > 0)
+    cache = std::make_unique<PerftCache>(hashMb);
+
+  int checks = 0, failed = 0;
+  uint64_t totalNodes = 0;
+  double totalSeconds = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    const SuiteEntry& e = entries[i];
+    for (int d = 1; d < int(e.counts.size()) && d <= maxDepth; d++) {
+      if (!e.counts[d])
+        continue;
+
+      Board b;
+      b.loadFEN(e.fen);
+      PerftResult r = perft_parallel(b, d, threads, cache.get());
+      bool pass = r.nodes == e.counts[d];
+      checks++;
+      failed += !pass;
+      totalNodes += r.nodes;
+      totalSeconds += r.seconds;
+
+      std::cout << "position " << i + 1 << " depth " << d << " nodes " << r.nodes
+                << " expected " << e.counts[d] << " nps " << r.nps() << (pass ? " pass" : " FAIL") << "\n";
+      if (!pass) {
+        std::cout << "  fen " << e.fen << "\n";
+        for (auto& [m, nodes] : r.divide)
+          std::cout << "  " << moveStr(m) << ": " << nodes << "\n";
+      }
+    }
+  }
+
+  std::cout << "suite positions=" << entries.size() << " checks=" << checks << " failed=" << failed
+            << " nodes=" << totalNodes << " seconds=" << totalSeconds
+            << " nps=" << uint64_t(totalSeconds > 0 ? totalNodes / totalSeconds : 0) << std::endl;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace Leaf {
+
+  //records wall time of each init stage, printed with --startup-profile
+  struct StartupProfile {
+    using Clock = std::chrono::steady_clock;
+
+    struct Stage {
+      std::string name;
+      double ms;
+    };
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point last = start;
+    std::vector<Stage> stages;
+
+    void mark (const std::string& name) {
+      Clock::time_point now = Clock::now();
+      stages.push_back({name, std::chrono::duration<double, std::milli>(now - last).count()});
+      last = now;
+    }
+
+    void print (std::ostream& os = std::cout) const {
+      for (const Stage& s : stages)
+        os << "startup " << s.name << " " << s.ms << " ms\n";
+      os << "startup total " << std::chrono::duration<double, std::milli>(last - start).count() << " ms" << std::endl;
+    }
+  };
+}
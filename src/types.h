@@ -13,6 +13,7 @@ namespace Leaf {
 
   constexpr int MAX_MOVES = 256;
   constexpr int MAX_PLY = 246;
+  constexpr int MAX_GAME_PLY = 1024;
 
   enum Color {
     WHITE, BLACK,
@@ -85,7 +86,7 @@ namespace Leaf {
     PIECE_TYPE_NB = 8
   };
 
-  enum Piece {
+  enum Piece : uint8_t {
     NO_PIECE,
     W_PAWN, W_KNIGHT, W_BISHOP, W_ROOK, W_QUEEN, W_KING,
     B_PAWN = PAWN + 8, B_KNIGHT, B_BISHOP, B_ROOK, B_QUEEN, B_KING,
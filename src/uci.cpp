@@ -14,7 +14,7 @@
 
 namespace Leaf {
 
-  Board board;
+  Engine engine;
   //Gloabal flags
   std::atomic<bool> clientConnected(false);
   std::atomic<bool> acceptClient(true);
@@ -30,16 +30,19 @@ namespace Leaf {
   void handleCommand (Output& out, std::string cmd);
   std::string moveToString(const Move& m);
   std::string pvToStr();
-  Move stringToMove (std::string m);
-  void goMove (Output& out, int depth);
-  void goPerft (Output& out, int depth);
-  void goSelf (Output& out, int depth);
+  Move stringToMove (Board& b, std::string m);
+  bool playMoves (Output& out, Board& b, const std::vector<std::string>& words, size_t start);
+  std::unique_ptr<Board> rootCopy ();
+  bool parseLimits (const std::vector<std::string>& words, SearchLimits& limits);
+  void goMove (Output& out, std::unique_ptr<Board> root, SearchLimits limits, uint64_t id);
+  void goPerft (Output& out, std::unique_ptr<Board> root, int depth, int threads, int hashMb);
+  void goSelf (Output& out, std::unique_ptr<Board> root, int depth, uint64_t id);
 
 
 
   void UCI_LOOP () {
     SERVER_FD = startServer(5000);
-    board.init();
+    engine.board.init();
 
     std::thread acceptThread(acceptingClient, SERVER_FD);
     std::thread listenThread1(listenTerminal);
@@ -131,124 +134,218 @@ namespace Leaf {
     auto words = split(cmd);
     //command phraser
     if (words[0] =="quit") {
+      //the search threads are detached, let a running one finish before
+      //the session is torn down at exit
+      engine.search.stop();
+      std::lock_guard<std::mutex> lock(engine.busy);
       isRunning.store(false);
       acceptClient.store(false);
       return;
     }
     else if (words[0] == "uci") {
       out.send("id name Leaf");
+      out.send("option name Threads type spin default 1 min 1 max 512");
       out.send("uciok");
       return;
     }
+    else if (words[0] == "ucinewgame") {
+      //a running go holds busy until it ends, an infinite one never would
+      engine.search.stop();
+      std::lock_guard<std::mutex> lock(engine.busy);
+      engine.search.clear();
+      return;
+    }
+    else if (words[0] == "setoption") {
+      //setoption name <id> value <x>
+      if (words.size() > 4 && words[2] == "Threads" && words[3] == "value")
+        engine.search.threads = std::max(1, std::stoi(words[4]));
+      else
+        out.send(UNKNOWN);
+      return;
+    }
     else if (words[0] == "isready") {
       out.send("readyok");
       return;
     }
     else if (words[0] == "stop") {
-      stopSearch.store(true);
+      engine.search.stop();
+      return;
+    }
+    else if (words[0] == "ponderhit") {
+      engine.search.ponderhit();
       return;
     }
     else if (words[0] == "d" || words[0] == "board") {
-      board.print();
+      engine.board.print();
     }
     else if (words[0] == "go") {
 
 
-      if (words[1] == "depth") {
-        int depth = std::stoi(words[2]);
-        std::thread searchThread(goMove, std::ref(out), depth);
-        searchThread.detach();
-      }
-      else if (words[1] == "self") {
+      if (words.size() > 2 && words[1] == "self") {
         int depth = std::stoi(words[2]);
-        std::thread selfThread(goSelf, std::ref(out), depth);
+        std::thread selfThread(goSelf, std::ref(out), rootCopy(), depth, engine.search.issue());
         selfThread.detach();
       }
-      else if (words[1] == "perft") {
+      else if (words.size() > 2 && words[1] == "perft") {
+        //go perft <depth> [threads <n>] [hash <mb>], no hash counts every node
         int depth = std::stoi(words[2]);
-        std::thread perftThread(goPerft, std::ref(out), depth);
+        int threads = 1, hashMb = 0;
+        for (size_t i = 3; i + 1 < words.size(); i += 2) {
+          if (words[i] == "threads")
+            threads = std::stoi(words[i + 1]);
+          else if (words[i] == "hash")
+            hashMb = std::stoi(words[i + 1]);
+        }
+        std::thread perftThread(goPerft, std::ref(out), rootCopy(), depth, threads, hashMb);
         perftThread.detach();
       }
       else {
-        out.send(UNKNOWN);
+        //go [ponder] [depth d] [wtime t] [btime t] [winc t] [binc t]
+        //   [movestogo n] [movetime t] [nodes n] [infinite], a bare go runs
+        //   until stop
+        SearchLimits limits;
+        if (!parseLimits(words, limits)) {
+          out.send(UNKNOWN);
+          return;
+        }
+        std::thread searchThread(goMove, std::ref(out), rootCopy(), limits, engine.search.issue());
+        searchThread.detach();
       }
 
     }
     else if (words[0] == "position") {
-
-      if (words[1] == "startpos") {
-        board.init();
-
-        for (int i = 2; i < words.size(); i++) {
-          if (words[i] == "moves")
-            continue;
-          Move move = stringToMove(words[i]);
-          Board::State state;
-          board.MakeMove(move, state);
-        }
+      //position startpos|fen <fen>|move [moves <m>...], built on a scratch
+      //board so a bad fen or move rejects the whole command and the
+      //previous position stays
+      Board next;
+      size_t i = 2;
+      if (words.size() > 1 && words[1] == "startpos") {
+        next.init();
       }
-      else if (words[1] == "fen") {
+      else if (words.size() > 1 && words[1] == "fen") {
 
         std::string fen;
-
-        for (int i = 2; i < 8; i++) {
+        for (; i < words.size() && words[i] != "moves"; i++) {
           fen += words[i] + " ";
         }
-        board.loadFEN(fen);
-
-        for (int i = 8; i < words.size(); i++) {
-          if (words[i] == "moves")
-            continue;
-          Move move = stringToMove(words[i]);
-          Board::State state;
-          board.MakeMove(move, state);
+        if (!next.loadFEN(fen)) {
+          out.send("info string invalid fen " + fen);
+          return;
         }
       }
-      else if (words[1] == "move") {
-        for (int i = 2; i < words.size(); i++) {
-          if (words[i] == "moves")
-            continue;
-          Move move = stringToMove(words[i]);
-          Board::State state;
-          board.MakeMove(move, state);
-        }
+      else if (words.size() > 1 && words[1] == "move") {
+        next = engine.board.fork();
       }
       else {
         out.send(UNKNOWN);
+        return;
       }
 
+      if (playMoves(out, next, words, i))
+        engine.board = std::move(next);
     }
     else {
       out.send(UNKNOWN);
     }
   }
 
-  void goMove (Output& out, int depth) {
-    Move m = SearchMove(board, depth);
+  //plays the moves of a position command on b. the board keeps MAX_PLY
+  //states of room for the search, a game past MAX_GAME_PLY or an illegal
+  //move fails the command
+  bool playMoves (Output& out, Board& b, const std::vector<std::string>& words, size_t start) {
+    for (size_t i = start; i < words.size(); i++) {
+      if (words[i] == "moves")
+        continue;
+      if (b.history.size() >= MAX_GAME_PLY) {
+        out.send("info string game longer than " + std::to_string(MAX_GAME_PLY) + " plies, position ignored");
+        return false;
+      }
+      Move move = stringToMove(b, words[i]);
+      if (!move) {
+        out.send("info string illegal move " + words[i] + ", position ignored");
+        return false;
+      }
+      Board::State state;
+      b.MakeMove(move, state);
+    }
+    return true;
+  }
+
+  //the position as it is now, with its own history so the search does not
+  //depend on the session board staying put
+  std::unique_ptr<Board> rootCopy () {
+    return std::make_unique<Board>(engine.board.fork());
+  }
+
+  bool parseLimits (const std::vector<std::string>& words, SearchLimits& limits) {
+    for (size_t i = 1; i < words.size(); i++) {
+      const std::string& w = words[i];
+      if (w == "infinite") {
+        limits.infinite = true;
+        continue;
+      }
+      if (w == "ponder") {
+        limits.ponder = true;
+        continue;
+      }
+      if (i + 1 == words.size())
+        return false;
+      int v = std::stoi(words[++i]);
+      if (w == "depth") limits.depth = v;
+      else if (w == "wtime") limits.wtime = v;
+      else if (w == "btime") limits.btime = v;
+      else if (w == "winc") limits.winc = v;
+      else if (w == "binc") limits.binc = v;
+      else if (w == "movestogo") limits.movestogo = v;
+      else if (w == "movetime") limits.movetime = v;
+      else if (w == "nodes") limits.nodes = std::stoull(words[i]);
+      else return false;
+    }
+    //nothing but stop ends a bare go
+    if (words.size() == 1)
+      limits.infinite = true;
+    return true;
+  }
+
+  void goMove (Output& out, std::unique_ptr<Board> root, SearchLimits limits, uint64_t id) {
+    std::lock_guard<std::mutex> lock(engine.busy);
+    Move m = engine.search.SearchMove(*root, limits, id);
     std::string output = "bestmove ";
     output += moveToString(m);
     out.send(pvToStr());
     out.send(output);
   }
-  void goSelf (Output& out, int depth) {
+  void goSelf (Output& out, std::unique_ptr<Board> root, int depth, uint64_t id) {
+    std::lock_guard<std::mutex> lock(engine.busy);
     std::vector<Move> pgn;
-    stopSearch.store(false);
-    while (!stopSearch.load()) {
+    do {
       std::cout << "Loop running.." << std::endl;
-      Move m = SearchMove(board, depth);
+      Move m = engine.search.SearchMove(*root, depth, id);
+      //mate, stalemate, or a game the history has no room left for
+      if (!m || root->history.size() >= MAX_GAME_PLY)
+        break;
       Board::State st;
-      board.MakeMove(m, st);
+      root->MakeMove(m, st);
       pgn.push_back(m);
       std::string pgndata = " ";
       for (auto M : pgn) {
         pgndata += moveToString(M) + " ";
       }
       out.send(pgndata);
-    }
+    } while (!engine.search.stopped(id));
   }
-  void goPerft (Output& out, int depth) {
-    int nodes = perft(board, depth);
-    out.send("Nodes searched: " + std::to_string(nodes));
+  void goPerft (Output& out, std::unique_ptr<Board> root, int depth, int threads, int hashMb) {
+    std::unique_ptr<PerftCache> cache;
+    if (hashMb > 0)
+      cache = std::make_unique<PerftCache>(hashMb);
+
+    PerftResult r = perft_parallel(*root, depth, threads, cache.get());
+    for (auto& [m, nodes] : r.divide)
+      out.send(moveToString(m) + ": " + std::to_string(nodes));
+    out.send("Nodes searched: " + std::to_string(r.nodes));
+    out.send("Time " + std::to_string(r.seconds) + " Nps " + std::to_string(r.nps()));
+    if (cache)
+      out.send("Cache hit rate " + std::to_string(r.hitRate()));
   }
 
 }
@@ -285,7 +382,9 @@ std::string moveToString(const Move& m) {
     return uci;
 }
 
-Move stringToMove (std::string m) {
+Move stringToMove (Board& b, std::string m) {
+  if (m.size() != 4 && m.size() != 5)
+    return Move::none();
   int ff = m[0] - 'a';
   int fr = m[1] - '1';
   int tf = m[2] - 'a';
@@ -295,7 +394,7 @@ Move stringToMove (std::string m) {
   Move move = Move::none();
 
   MoveList list;
-  LegalMoves(board, list);
+  LegalMoves(b, list);
   for (int i = 0; i < list.count; i++) {
     if (f == list.data[i].from_sq() && t == list.data[i].to_sq()) {
       if (m.size() != 5)
@@ -312,7 +411,7 @@ Move stringToMove (std::string m) {
 
 std::string pvToStr() {
   std::string s = "PV: ";
-  auto v = readPV();
+  auto v = engine.search.readPV();
   for (auto u : v) {
     s += moveToString(u) + " ";
   }
@@ -6,6 +6,8 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <memory>
+#include <mutex>
 
 
 #include "engine.h"
@@ -75,5 +77,16 @@ namespace Leaf {
   };
 /*------------------------struct for eaze of input and output---------------------*/
 
+  //one uci session: the position set by the gui and the search that plays
+  //from it. go searches a copy of the position, so a position command
+  //arriving mid search cannot change the board under it
+  struct Engine {
+    TT tt;
+    Search search{tt};
+    Board board;
+    //held for the whole of a go, one search per session at a time
+    std::mutex busy;
+  };
+
   void UCI_LOOP();
 }
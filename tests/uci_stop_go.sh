@@ -0,0 +1,53 @@
+#!/bin/sh
+# stop applies to the searches sent before it and to no later go: a stop
+# right before the next go ends the running search, the new go still
+# plays, and a stop right after a go ends that go even before it starts.
+# usage: uci_stop_go.sh <app>
+app=$1
+dir=$(mktemp -d)
+mkfifo "$dir/in"
+"$app" < "$dir/in" > "$dir/out" 2>&1 &
+pid=$!
+exec 3> "$dir/in"
+
+fail () {
+  echo "FAIL: $1"
+  cat "$dir/out"
+  kill "$pid" 2>/dev/null
+  rm -rf "$dir"
+  exit 1
+}
+
+# waits up to 10 s for the output to hold $2 lines matching $1
+wait_for () {
+  i=0
+  while [ "$(grep -c "$1" "$dir/out")" -lt "$2" ]; do
+    i=$((i + 1))
+    [ "$i" -gt 100 ] && return 1
+    sleep 0.1
+  done
+}
+
+echo "isready" >&3
+wait_for readyok 1 || fail "no readyok"
+
+echo "position startpos" >&3
+echo "go infinite" >&3
+sleep 0.3
+echo "stop" >&3
+echo "go depth 3" >&3
+wait_for bestmove 2 || fail "stop followed by go lost the stop or the go"
+
+echo "stop" >&3
+echo "go depth 3" >&3
+wait_for bestmove 3 || fail "a stop before go ended the go"
+
+echo "go infinite" >&3
+echo "stop" >&3
+wait_for bestmove 4 || fail "a stop right after go was lost"
+
+echo "quit" >&3
+exec 3>&-
+wait "$pid" || fail "app exited with an error"
+rm -rf "$dir"
+echo "ok"